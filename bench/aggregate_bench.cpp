@@ -0,0 +1,289 @@
+// Compares the runtime-frame AskBidMerger::get_next_candle against the
+// compile-time FrameAggregator, end to end on synthetic tick files (also with
+// ASK and BID parsed on their own threads) and on pre-merged ticks in memory
+// (bucketing cost only). Then times hour files read by concatenation against
+// MergingTickSource, also with every hour repeating the tail of the previous
+// one, which the merge must drop again.
+//
+//   aggregate_bench [ticks_per_side]
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../src/transform/aggregate.h"
+#include "../src/transform/merging_source.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+volatile double benchmark_sink;
+
+struct VectorSource {
+	const std::vector<TickEntry>& ticks;
+	const std::vector<double>& spreads;
+	size_t pos = 0;
+
+	bool
+	get_next_mid_tick(TickEntry& out) {
+		if (pos >= ticks.size()) return false;
+		out = ticks[pos++];
+		return true;
+	}
+
+	double
+	spread() const { return spreads[pos - 1]; }
+};
+
+// the per-tick division loop of AskBidMerger::get_next_candle
+size_t
+runtime_bars(VectorSource& src, std::int64_t frame) {
+	size_t n = 0;
+	TickEntry tick{};
+	bool has = src.get_next_mid_tick(tick);
+
+	while (has) {
+		auto bucket = tick.epoch / frame;
+		Candle c {
+			.time = bucket * frame,
+			.tick_count = 1,
+			.open = tick.price, .high = tick.price, .low = tick.price, .close = tick.price,
+		};
+
+		while ((has = src.get_next_mid_tick(tick)) && tick.epoch / frame == bucket) {
+			c.high = std::max(c.high, tick.price);
+			c.low = std::min(c.low, tick.price);
+			c.close = tick.price;
+			++c.tick_count;
+		}
+		++n;
+		benchmark_sink = c.close;
+	}
+	return n;
+}
+
+template <std::int64_t Frame, typename... Aggs>
+size_t
+template_bars(VectorSource& src) {
+	FrameAggregator<VectorSource, Frame, Aggs...> aggregator{src};
+	typename decltype(aggregator)::bar_type bar;
+
+	size_t n = 0;
+	while (aggregator.get_next(bar)) {
+		++n;
+		benchmark_sink = bar.close;
+	}
+	return n;
+}
+
+void
+write_side(const fs::path& path, std::int64_t start, size_t count, double offset, unsigned seed) {
+	std::ofstream out(path);
+	std::int64_t t = start;
+	double price = 1.1;
+
+	for (size_t i = 0; i < count; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		t += 1 + (seed >> 24) % 40;
+		price += ((seed >> 8) % 200 - 100.0) * 1e-7;
+		out << t << ',' << (price + offset) << ",1.0\n";
+	}
+}
+
+// Splits a side into hour files named <side>_00, <side>_01, ...; with
+// overlap_ms > 0 each file also starts with that much of the previous hour.
+std::vector<std::string>
+split_hours(const fs::path& dir, const std::string& side, std::int64_t overlap_ms) {
+	std::vector<std::pair<std::int64_t, std::string>> lines{};
+	{
+		std::ifstream in(dir / side);
+		std::string line;
+		while (std::getline(in, line)) {
+			TickEntry tick{};
+			if (parse_tick_line(line, tick)) lines.emplace_back(tick.epoch, line);
+		}
+	}
+
+	const std::string prefix = side + (overlap_ms ? "_overlap_" : "_");
+	const std::int64_t hour = 60 * 60 * 1000;
+	const auto first = lines.front().first / hour;
+
+	std::vector<std::string> names{};
+	std::ofstream out;
+
+	for (size_t i = 0; i < lines.size(); ++i) {
+		const auto h = lines[i].first / hour;
+		if (names.size() <= static_cast<size_t>(h - first)) {
+			out.close();
+			names.push_back(prefix + std::to_string(h - first));
+			out.open(dir / names.back());
+
+
+			// replay the tail of the previous hour
+			size_t k = i;
+			while (overlap_ms && k > 0 && lines[k - 1].first >= h * hour - overlap_ms) --k;
+			for (; k < i; ++k) out << lines[k].second << '\n';
+		}
+		out << lines[i].second << '\n';
+	}
+
+	return names;
+}
+
+// best of a few runs
+double
+seconds(const std::function<void()>& fn, int runs = 1) {
+	double best = 1e300;
+	for (int i = 0; i < runs; ++i) {
+		const auto start = std::chrono::steady_clock::now();
+		fn();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+bool
+same(std::span<const Candle> a, std::span<const Candle> b) {
+	return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(Candle)) == 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+	const size_t ticks = argc > 1 ? std::stoull(argv[1]) : 2'000'000;
+
+	const auto dir = fs::temp_directory_path() / ("aggregate_bench_" + std::to_string(::getpid()));
+	fs::create_directories(dir);
+
+	const std::int64_t start = 1'700'000'000'000;
+	write_side(dir / "ask", start, ticks, 5e-5, 1);
+	write_side(dir / "bid", start, ticks, -5e-5, 2);
+
+	auto merger = [&](std::int64_t frame, bool threaded = false) {
+		return AskBidMerger {
+			make_tick_source(MultiFileReader({"ask"}, dir), threaded),
+			make_tick_source(MultiFileReader({"bid"}, dir), threaded),
+			frame
+		};
+	};
+
+	// pre-merge once for the in-memory runs
+	std::vector<TickEntry> mids{};
+	std::vector<double> spreads{};
+	{
+		auto m = merger(15 * 1000);
+		TickEntry t{};
+		while (m.get_next_mid_tick(t)) {
+			mids.push_back(t);
+			spreads.push_back(m.spread());
+		}
+	}
+	std::printf("%zu ticks per side, %zu mid ticks\n\n", ticks, mids.size());
+
+	// opaque to the optimizer, like the frame read at runtime in main
+	volatile std::int64_t frames[] = { 1000, 15000, 60000, 300000, 3600000 };
+
+	std::printf("%-8s %14s %14s %14s %14s %14s %14s\n",
+		"frame", "file runtime", "file template", "file threaded",
+		"mem runtime", "mem template", "mem +spread");
+
+	for (auto& vf : frames) {
+		const std::int64_t frame = vf;
+
+		std::vector<Candle> a{};
+		std::pmr::vector<Candle> b{};
+		const auto file_runtime = seconds([&] {
+			auto m = merger(frame);
+			Candle c;
+			while (m.get_next_candle(c)) a.push_back(c);
+		});
+		const auto file_template = seconds([&] {
+			auto m = merger(frame);
+			aggregate_candles(m, frame, b);
+		});
+		std::pmr::vector<Candle> t{};
+		const auto file_threaded = seconds([&] {
+			auto m = merger(frame, true);
+			aggregate_candles(m, frame, t);
+		});
+		if (!same(a, b) || !same(a, t)) std::printf("MISMATCH at frame %lld\n", static_cast<long long>(frame));
+
+		size_t n_runtime = 0, n = 0, n_spread = 0;
+
+		auto mem = [&](auto run) {
+			return seconds([&] { VectorSource src{mids, spreads}; run(src); }, 5);
+		};
+
+		const auto mem_runtime = mem([&](VectorSource& s) { n_runtime = runtime_bars(s, frame); });
+
+		double mem_template = 0, mem_spread = 0;
+		switch (frame) {
+#define BENCH_FRAME(F) \
+			case F: \
+				mem_template = mem([&](VectorSource& s) { n = template_bars<F, agg::Ohlc, agg::TickCount>(s); }); \
+				mem_spread = mem([&](VectorSource& s) { n_spread = template_bars<F, agg::Ohlc, agg::TickCount, agg::Spread>(s); }); \
+				break;
+			BENCH_FRAME(1000)
+			BENCH_FRAME(15000)
+			BENCH_FRAME(60000)
+			BENCH_FRAME(300000)
+			BENCH_FRAME(3600000)
+#undef BENCH_FRAME
+		}
+		if (n != n_runtime || n_spread != n_runtime) std::printf("COUNT MISMATCH at frame %lld\n", static_cast<long long>(frame));
+
+		std::printf("%-8lld %12.1fms %12.1fms %12.1fms %12.2fms %12.2fms %12.2fms\n",
+			static_cast<long long>(frame),
+			file_runtime * 1e3, file_template * 1e3, file_threaded * 1e3,
+			mem_runtime * 1e3, mem_template * 1e3, mem_spread * 1e3);
+	}
+
+	// hour files, concatenated against merged
+	const auto ask_hours = split_hours(dir, "ask", 0);
+	const auto bid_hours = split_hours(dir, "bid", 0);
+	const auto ask_overlap = split_hours(dir, "ask", 5 * 60 * 1000);
+	const auto bid_overlap = split_hours(dir, "bid", 5 * 60 * 1000);
+
+	auto concat = [&](const std::vector<std::string>& ask, const std::vector<std::string>& bid) {
+		return AskBidMerger {
+			make_tick_source(MultiFileReader(ask, dir), false),
+			make_tick_source(MultiFileReader(bid, dir), false),
+			15 * 1000
+		};
+	};
+	auto merged = [&](const std::vector<std::string>& ask, const std::vector<std::string>& bid, MergeStats& stats) {
+		return AskBidMerger {
+			std::make_unique<MergingTickSource>(ask, dir, 1000, &stats),
+			std::make_unique<MergingTickSource>(bid, dir, 1000, &stats),
+			15 * 1000
+		};
+	};
+
+	std::pmr::vector<Candle> c{}, m{}, o{};
+	MergeStats clean{}, overlap{};
+
+	const auto t_concat = seconds([&] { c.clear(); auto r = concat(ask_hours, bid_hours); aggregate_candles(r, 15 * 1000, c); }, 3);
+	const auto t_merged = seconds([&] { m.clear(); clean = {}; auto r = merged(ask_hours, bid_hours, clean); aggregate_candles(r, 15 * 1000, m); }, 3);
+	const auto t_overlap = seconds([&] { o.clear(); overlap = {}; auto r = merged(ask_overlap, bid_overlap, overlap); aggregate_candles(r, 15 * 1000, o); }, 3);
+
+	std::printf("\n%zu hour files per side, frame 15000\n", ask_hours.size());
+	std::printf("%-24s %10.1fms\n", "concatenated", t_concat * 1e3);
+	std::printf("%-24s %10.1fms  dropped %llu\n", "merged", t_merged * 1e3,
+		static_cast<unsigned long long>(clean.duplicates + clean.late));
+	std::printf("%-24s %10.1fms  dropped %llu duplicate, %llu late\n", "merged, 5m overlap", t_overlap * 1e3,
+		static_cast<unsigned long long>(overlap.duplicates), static_cast<unsigned long long>(overlap.late));
+
+	if (!same(c, m) || !same(c, o)) std::printf("MISMATCH merging hour files\n");
+
+	fs::remove_all(dir);
+}
@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "loopback_ftp.h"
+
+namespace {
+
+void
+throw_errno(const std::string& what) {
+	throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+int
+listen_local(std::uint16_t& port) {
+	int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) throw_errno("socket");
+
+	int one = 1;
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) throw_errno("bind");
+	if (::listen(fd, 64) != 0) throw_errno("listen");
+
+	socklen_t len = sizeof(addr);
+	::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+	port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+bool
+send_all(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+		if (sent <= 0) return false;
+
+		data += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+// Sends at most bandwidth_bps, pacing 16 KB chunks against a start clock.
+// With stop_at < size the connection is cut after stop_at bytes.
+bool
+send_paced(int fd, std::string_view data, std::uint64_t bandwidth_bps, size_t stop_at) {
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+
+	constexpr size_t chunk = 16 * 1024;
+	const auto limit = std::min(stop_at, data.size());
+
+	for (size_t pos = 0; pos < limit; pos += chunk) {
+		const auto n = std::min(chunk, limit - pos);
+		if (!send_all(fd, data.data() + pos, n)) return false;
+
+		if (bandwidth_bps == 0) continue;
+
+		const auto due = start + std::chrono::microseconds((pos + n) * 1'000'000 / bandwidth_bps);
+		std::this_thread::sleep_until(due);
+	}
+
+	return limit == data.size();
+}
+
+// Ends a transfer like a real server: our side is shut down and the client's
+// close awaited before the 226 goes out, so the reply always follows the
+// end of the data rather than racing it.
+void
+finish_data(int data_fd) {
+	::shutdown(data_fd, SHUT_WR);
+
+	timeval timeout{ .tv_sec = 5, .tv_usec = 0 };
+	::setsockopt(data_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	char drain[256];
+	while (::recv(data_fd, drain, sizeof(drain), 0) > 0) {}
+
+	::close(data_fd);
+}
+
+std::string
+gzip_string(const std::string& data) {
+	z_stream stream{};
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("deflateInit2 failed");
+	}
+
+	std::string out(deflateBound(&stream, data.size()), '\0');
+
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	stream.avail_in = static_cast<uInt>(data.size());
+	stream.next_out = reinterpret_cast<Bytef*>(out.data());
+	stream.avail_out = static_cast<uInt>(out.size());
+
+	const int ret = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	if (ret != Z_STREAM_END) throw std::runtime_error("deflate failed");
+	return out;
+}
+
+std::string
+resolve(const std::string& cwd, const std::string& arg) {
+	if (arg.empty()) return cwd;
+	if (arg.front() == '/') return arg;
+	if (cwd == "/") return "/" + arg;
+	return cwd + "/" + arg;
+}
+
+std::string
+strip_slash(std::string path) {
+	while (path.size() > 1 && path.back() == '/') path.pop_back();
+	return path;
+}
+
+}
+
+LoopbackFtpServer::LoopbackFtpServer(FtpTree tree, LoopbackFtpOptions options):
+	tree(std::move(tree)), options(options), rng_state(options.seed * 0x9E3779B97F4A7C15ULL + 1)
+{
+	listen_fd = listen_local(port);
+	acceptor = std::thread([this] { accept_loop(); });
+}
+
+LoopbackFtpServer::~LoopbackFtpServer() {
+	stopping = true;
+
+	::shutdown(listen_fd, SHUT_RDWR);
+	::close(listen_fd);
+	acceptor.join();
+
+	{
+		std::lock_guard lock(sessions_mutex);
+		for (int fd : session_fds) ::shutdown(fd, SHUT_RDWR);
+	}
+	for (auto& t : sessions) t.join();
+}
+
+std::string
+LoopbackFtpServer::url() const {
+	return "ftp://127.0.0.1:" + std::to_string(port);
+}
+
+bool
+LoopbackFtpServer::roll_failure() {
+	if (options.fail_rate <= 0.0) return false;
+
+	// splitmix64, shared by all sessions
+	std::uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+
+	return static_cast<double>(z >> 11) / static_cast<double>(1ULL << 53) < options.fail_rate;
+}
+
+void
+LoopbackFtpServer::accept_loop() {
+	while (!stopping) {
+		int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (stopping) return;
+			continue;
+		}
+
+		// replies are tiny; don't let Nagle hold them for the client's ACK
+		int one = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		std::lock_guard lock(sessions_mutex);
+		session_fds.push_back(fd);
+		sessions.emplace_back([this, fd] { session(fd); });
+	}
+}
+
+void
+LoopbackFtpServer::session(int fd) {
+	auto reply = [&](const std::string& line) {
+		if (options.latency_ms) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(options.latency_ms));
+		}
+		const auto msg = line + "\r\n";
+		return send_all(fd, msg.data(), msg.size());
+	};
+
+	std::string cwd = "/";
+	int pasv_fd = -1;
+	std::string pending;
+	size_t rest = 0;		// REST offset for the next RETR
+
+	auto take_data_conn = [&]() {
+		if (pasv_fd < 0) return -1;
+
+		int data_fd = ::accept4(pasv_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		::close(pasv_fd);
+		pasv_fd = -1;
+
+		return data_fd;
+	};
+
+	if (!reply("220 loopback ftp ready")) {
+		::close(fd);
+		return;
+	}
+
+	char buf[4096];
+	while (!stopping) {
+		auto eol = pending.find("\r\n");
+		if (eol == std::string::npos) {
+			auto got = ::recv(fd, buf, sizeof(buf), 0);
+			if (got <= 0) break;
+
+			pending.append(buf, static_cast<size_t>(got));
+			continue;
+		}
+
+		const auto line = pending.substr(0, eol);
+		pending.erase(0, eol + 2);
+
+		const auto space = line.find(' ');
+		auto cmd = line.substr(0, space);
+		const auto arg = space == std::string::npos ? std::string{} : line.substr(space + 1);
+		std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+
+		bool ok = true;
+		if (cmd == "USER") ok = reply("331 password required");
+		else if (cmd == "PASS") ok = reply("230 logged in");
+		else if (cmd == "PWD") ok = reply("257 \"" + cwd + "\"");
+		else if (cmd == "TYPE") ok = reply("200 type set");
+		else if (cmd == "QUIT") { reply("221 bye"); break; }
+		else if (cmd == "CWD") {
+			cwd = strip_slash(resolve(cwd, arg));
+			ok = reply("250 directory changed");
+		} else if (cmd == "EPSV" || cmd == "PASV") {
+			if (pasv_fd >= 0) ::close(pasv_fd);
+
+			std::uint16_t data_port = 0;
+			pasv_fd = listen_local(data_port);
+
+			if (cmd == "EPSV") {
+				ok = reply("229 Entering Extended Passive Mode (|||" + std::to_string(data_port) + "|)");
+			} else {
+				ok = reply("227 Entering Passive Mode (127,0,0,1,"
+					+ std::to_string(data_port >> 8) + "," + std::to_string(data_port & 0xff) + ")");
+			}
+		} else if (cmd == "SIZE") {
+			auto iter = tree.find(resolve(cwd, arg));
+			ok = iter == tree.end()
+				? reply("550 no such file")
+				: reply("213 " + std::to_string(iter->second.size()));
+		} else if (cmd == "NLST") {
+			const auto dir = strip_slash(resolve(cwd, arg));
+			const auto prefix = dir == "/" ? dir : dir + "/";
+
+			std::string listing;
+			for (auto iter = tree.lower_bound(prefix); iter != tree.end(); ++iter) {
+				if (iter->first.compare(0, prefix.size(), prefix) != 0) break;
+				listing += iter->first.substr(prefix.size()) + "\r\n";
+			}
+
+			int data_fd = take_data_conn();
+			if (data_fd < 0) {
+				if (!reply("425 use EPSV first")) break;
+				continue;
+			}
+
+			ok = reply("150 listing");
+			send_all(data_fd, listing.data(), listing.size());
+			finish_data(data_fd);
+			ok = ok && reply("226 listing sent");
+		} else if (cmd == "REST") {
+			rest = std::strtoull(arg.c_str(), nullptr, 10);
+			ok = reply("350 restarting at " + std::to_string(rest));
+		} else if (cmd == "RETR") {
+			const auto offset = std::exchange(rest, 0);
+			auto iter = tree.find(resolve(cwd, arg));
+			if (iter == tree.end()) {
+				if (pasv_fd >= 0) { ::close(pasv_fd); pasv_fd = -1; }
+				if (!reply("550 no such file")) break;
+				continue;
+			}
+
+			int data_fd = take_data_conn();
+			if (data_fd < 0) {
+				if (!reply("425 use EPSV first")) break;
+				continue;
+			}
+
+			const bool fail = roll_failure();
+			const auto data = std::string_view(iter->second).substr(std::min(offset, iter->second.size()));
+
+			ok = reply("150 opening data connection");
+			const bool sent = send_paced(data_fd, data, options.bandwidth_bps, fail ? data.size() / 2 : data.size());
+
+			// a cut transfer is not lingered over, the client sees it end early
+			if (fail) ::close(data_fd);
+			else finish_data(data_fd);
+
+			if (fail) {
+				++failures;
+				ok = ok && reply("426 transfer aborted (injected)");
+			} else {
+				ok = ok && reply(sent ? "226 transfer complete" : "426 transfer aborted");
+			}
+		} else {
+			ok = reply("502 command not implemented");
+		}
+
+		if (!ok) break;
+	}
+
+	if (pasv_fd >= 0) ::close(pasv_fd);
+	::close(fd);
+}
+
+FtpTree
+make_darwinex_tree(	const std::vector<std::string>& symbols,
+					int days,
+					int ticks_per_hour)
+{
+	using namespace std::chrono;
+
+	FtpTree tree{};
+	const sys_days first = year{2023} / January / 2;
+
+	std::uint64_t state = 42;
+	auto next = [&]() {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return static_cast<double>(state >> 33) / static_cast<double>(1ULL << 31);
+	};
+
+	for (const auto& symbol : symbols) {
+		double price = 1.0;
+
+		for (int d = 0; d < days; ++d) {
+			const sys_days day = first + std::chrono::days{d};
+			const year_month_day ymd{day};
+
+			char key[16];
+			std::snprintf(key, sizeof(key), "%04d-%02u-%02u",
+				static_cast<int>(ymd.year()), static_cast<unsigned>(ymd.month()), static_cast<unsigned>(ymd.day()));
+
+			for (int hour = 0; hour < 24; ++hour) {
+				const auto hour_start = duration_cast<milliseconds>((day + hours{hour}).time_since_epoch()).count();
+				const auto step = 3'600'000 / std::max(ticks_per_hour, 1);
+
+				std::string ask, bid;
+				for (int t = 0; t < ticks_per_hour; ++t) {
+					price += (next() - 0.5) * 1e-4;
+					const auto epoch = hour_start + t * step;
+
+					char line[64];
+					std::snprintf(line, sizeof(line), "%lld,%.5f,1.0\n", static_cast<long long>(epoch), price + 5e-5);
+					ask += line;
+					std::snprintf(line, sizeof(line), "%lld,%.5f,1.0\n", static_cast<long long>(epoch), price - 5e-5);
+					bid += line;
+				}
+
+				char name[128];
+				std::snprintf(name, sizeof(name), "/%s/%s_ASK_%s_%02d.log.gz", symbol.c_str(), symbol.c_str(), key, hour);
+				tree[name] = gzip_string(ask);
+				std::snprintf(name, sizeof(name), "/%s/%s_BID_%s_%02d.log.gz", symbol.c_str(), symbol.c_str(), key, hour);
+				tree[name] = gzip_string(bid);
+			}
+		}
+	}
+
+	return tree;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Files served by path, e.g. /ADAUSD/ADAUSD_ASK_2023-01-02_00.log.gz
+using FtpTree = std::map<std::string, std::string>;
+
+struct LoopbackFtpOptions {
+	std::uint32_t latency_ms = 0;		// added before every control reply
+	std::uint64_t bandwidth_bps = 0;	// per data connection, 0 = unlimited
+	double fail_rate = 0.0;				// share of RETRs aborted mid-transfer
+	std::uint32_t seed = 1;
+};
+
+// Passive-mode FTP stand-in on 127.0.0.1, just enough of RFC 959 for curl:
+// USER/PASS, PWD/CWD, EPSV/PASV, TYPE, SIZE, NLST, REST, RETR and QUIT.
+class LoopbackFtpServer {
+public:
+	LoopbackFtpServer(FtpTree tree, LoopbackFtpOptions options);
+
+	LoopbackFtpServer(const LoopbackFtpServer&) = delete;
+
+	LoopbackFtpServer&
+	operator=(const LoopbackFtpServer&) = delete;
+
+	~LoopbackFtpServer();
+
+	std::string
+	url() const;
+
+	std::size_t
+	injected_failures() const { return failures; }
+
+private:
+	const FtpTree tree;
+	const LoopbackFtpOptions options;
+
+	int listen_fd = -1;
+	std::uint16_t port = 0;
+
+	std::atomic<bool> stopping = false;
+	std::atomic<std::size_t> failures = 0;
+	std::atomic<std::uint64_t> rng_state;
+
+	std::mutex sessions_mutex;
+	std::vector<int> session_fds;
+	std::vector<std::thread> sessions;
+	std::thread acceptor;
+
+	void
+	accept_loop();
+
+	void
+	session(int fd);
+
+	bool
+	roll_failure();
+};
+
+// Synthetic Darwinex layout: per symbol and day, 24 ASK and 24 BID hour
+// files of gzipped "epoch,price,size" ticks.
+FtpTree
+make_darwinex_tree(	const std::vector<std::string>& symbols,
+					int days,
+					int ticks_per_hour);
@@ -0,0 +1,177 @@
+// Offline load test for FtpClient: serves a synthetic Darwinex tree from a
+// loopback FTP server with injected latency, bandwidth limits and failures,
+// then lists and downloads it and reports throughput and retries.
+//
+//   ftp_loadtest --symbols=2 --days=3 --ticks=2000 --latency-ms=5
+//                --bandwidth-kbps=4096 --fail-rate=0.05 --retries=3
+//                --parallel=4 --mode=inflate
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+#include <curl/curl.h>
+
+#include "../../src/ftp/ftp_client.h"
+#include "./loopback_ftp.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Args = std::map<std::string, std::string>;
+
+Args
+parse_args(int argc, char** argv) {
+	Args args{};
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg.rfind("--", 0) != 0) throw std::runtime_error("unexpected argument: " + arg);
+
+		auto eq = arg.find('=');
+		if (eq == std::string::npos) args[arg.substr(2)] = "1";
+		else args[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+	}
+	return args;
+}
+
+template <typename T>
+T
+get(const Args& args, const std::string& key, T fallback) {
+	auto iter = args.find(key);
+	if (iter == args.end()) return fallback;
+
+	if constexpr (std::is_floating_point_v<T>) return static_cast<T>(std::stod(iter->second));
+	else return static_cast<T>(std::stoll(iter->second));
+}
+
+struct WorkerResult {
+	std::size_t files = 0;
+	std::size_t failed = 0;
+	std::size_t retries = 0;
+	std::uint64_t bytes = 0;
+};
+
+}
+
+int main(int argc, char** argv) {
+	const auto args = parse_args(argc, argv);
+
+	const auto symbol_count = get(args, "symbols", 2);
+	const auto days = get(args, "days", 2);
+	const auto ticks = get(args, "ticks", 2000);
+	const auto parallel = std::max(get(args, "parallel", 1), 1);
+	const auto mode = args.contains("mode") ? args.at("mode") : std::string{"file"};
+
+	const LoopbackFtpOptions server_opts {
+		.latency_ms = get<std::uint32_t>(args, "latency-ms", 0),
+		.bandwidth_bps = get<std::uint64_t>(args, "bandwidth-kbps", 0) * 1024,
+		.fail_rate = get(args, "fail-rate", 0.0),
+		.seed = get<std::uint32_t>(args, "seed", 1),
+	};
+
+	std::vector<std::string> symbols{};
+	for (int i = 0; i < symbol_count; ++i) symbols.push_back("SYM" + std::to_string(i) + "USD");
+
+	auto tree = make_darwinex_tree(symbols, days, ticks);
+
+	std::uint64_t tree_bytes = 0;
+	for (const auto& [path, data] : tree) tree_bytes += data.size();
+	std::printf("tree: %zu files, %.2f MB compressed\n", tree.size(), tree_bytes / 1e6);
+
+	LoopbackFtpServer server{std::move(tree), server_opts};
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	const FtpConfig cfg {
+		.url = server.url(),
+		.username = "bench",
+		.password = "bench",
+		.verbose = args.contains("verbose"),
+		.connect_timeout_ms = get(args, "connect-timeout-ms", 0L),
+		.timeout_ms = get(args, "timeout-ms", 0L),
+		.buffer_size = get(args, "buffer-size", 0L),
+		.max_retries = get<std::uint32_t>(args, "retries", 0),
+		.retry_delay_ms = get<std::uint32_t>(args, "retry-delay-ms", 10),
+	};
+
+	const auto out_dir = fs::temp_directory_path() / ("ftp_loadtest_" + std::to_string(::getpid()));
+	fs::create_directories(out_dir);
+
+	using clock = std::chrono::steady_clock;
+
+	// listing
+	std::vector<std::pair<std::string, std::string>> jobs{};
+	const auto list_start = clock::now();
+	{
+		FtpClient client;
+		client.connect(cfg);
+
+		for (const auto& symbol : symbols) {
+			for (auto& name : client.list_files(symbol)) jobs.emplace_back(symbol, std::move(name));
+		}
+	}
+	const std::chrono::duration<double> list_time = clock::now() - list_start;
+
+	// downloads, round-robin over workers with one connection each
+	std::vector<WorkerResult> results(parallel);
+	std::vector<std::thread> workers{};
+
+	const auto start = clock::now();
+	for (int w = 0; w < parallel; ++w) {
+		workers.emplace_back([&, w] {
+			FtpClient client;
+			client.connect(cfg);
+
+			auto& res = results[w];
+			for (std::size_t i = w; i < jobs.size(); i += parallel) {
+				const auto& [symbol, name] = jobs[i];
+				const auto out = out_dir / name;
+
+				try {
+					if (mode == "inflate") {
+						client.download_inflated(symbol, name, out_dir / fs::path(name).stem());
+					} else {
+						client.download_to_file(symbol, name, out_dir);
+					}
+
+					res.bytes += fs::file_size(mode == "inflate" ? out_dir / fs::path(name).stem() : out);
+					++res.files;
+				} catch (const std::exception& e) {
+					++res.failed;
+					if (cfg.verbose) std::cerr << e.what() << "\n";
+				}
+			}
+			res.retries = client.retry_count();
+		});
+	}
+	for (auto& t : workers) t.join();
+	const std::chrono::duration<double> elapsed = clock::now() - start;
+
+	WorkerResult total{};
+	for (const auto& r : results) {
+		total.files += r.files;
+		total.failed += r.failed;
+		total.retries += r.retries;
+		total.bytes += r.bytes;
+	}
+
+	std::printf("list:      %zu files in %.3f s\n", jobs.size(), list_time.count());
+	std::printf("download:  %zu ok, %zu failed in %.3f s (mode=%s, parallel=%d)\n",
+		total.files, total.failed, elapsed.count(), mode.c_str(), parallel);
+	std::printf("rate:      %.1f files/s, %.2f MB/s (%s bytes written)\n",
+		total.files / elapsed.count(), total.bytes / 1e6 / elapsed.count(),
+		mode == "inflate" ? "inflated" : "compressed");
+	std::printf("retries:   %zu (server injected %zu failures)\n", total.retries, server.injected_failures());
+
+	fs::remove_all(out_dir);
+	curl_global_cleanup();
+
+	return total.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+// Fixed-width columnar candle file, one per symbol and frame. Self-contained
+// (std and POSIX only) so consumers can map it without linking anything:
+//
+//   header       CandleFileHeader, 128 bytes
+//   index        int64 time of every index_stride-th row
+//   time         int64[count]
+//   tick_count   int64[count]
+//   open         double[count]
+//   high         double[count]
+//   low          double[count]
+//   close        double[count]
+//
+// Sections start on 64 byte boundaries and values are native endian; rows are
+// in ascending, unique time order.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+inline constexpr char CANDLE_FILE_MAGIC[8] = { 'C', 'A', 'N', 'D', 'L', 'C', 'O', 'L' };
+inline constexpr std::uint32_t CANDLE_FILE_VERSION = 1;
+inline constexpr std::uint32_t CANDLE_FILE_ENDIAN = 0x01020304;
+inline constexpr std::uint64_t CANDLE_FILE_ALIGN = 64;
+
+enum CandleFileSection : std::size_t {
+	SECTION_INDEX,
+	SECTION_TIME,
+	SECTION_TICK_COUNT,
+	SECTION_OPEN,
+	SECTION_HIGH,
+	SECTION_LOW,
+	SECTION_CLOSE,
+	SECTION_COUNT,
+};
+
+struct CandleFileHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t endian;			// CANDLE_FILE_ENDIAN as the writer saw it
+
+	std::int64_t frame;				// ms
+	std::uint64_t count;
+	std::int64_t first_time;		// 0 when empty
+	std::int64_t last_time;
+
+	std::uint64_t index_stride;
+	std::uint64_t index_count;
+
+	std::uint64_t offsets[SECTION_COUNT];	// from the start of the file
+	std::uint64_t file_size;
+};
+
+static_assert(sizeof(CandleFileHeader) == 128);
+
+// Header for count rows with an index entry every stride rows, including
+// the section offsets and the total file size.
+inline CandleFileHeader
+candle_file_layout(std::int64_t frame, std::uint64_t count, std::uint64_t stride) {
+	CandleFileHeader h{};
+
+	std::memcpy(h.magic, CANDLE_FILE_MAGIC, sizeof(h.magic));
+	h.version = CANDLE_FILE_VERSION;
+	h.endian = CANDLE_FILE_ENDIAN;
+
+	h.frame = frame;
+	h.count = count;
+	h.index_stride = stride;
+	h.index_count = (count + stride - 1) / stride;
+
+	auto align = [](std::uint64_t at) { return (at + CANDLE_FILE_ALIGN - 1) / CANDLE_FILE_ALIGN * CANDLE_FILE_ALIGN; };
+
+	std::uint64_t at = align(sizeof(CandleFileHeader));
+	h.offsets[SECTION_INDEX] = at;
+	at = align(at + h.index_count * sizeof(std::int64_t));
+
+	for (std::size_t s = SECTION_TIME; s < SECTION_COUNT; ++s) {
+		h.offsets[s] = at;
+		at = align(at + count * 8);
+	}
+
+	h.file_size = at;
+	return h;
+}
+
+// Read-only mapping of a candle file. Spans handed out point straight into
+// the mapping and stay valid while the object lives; a writer replacing the
+// file renames a new one into place, so an open mapping never changes.
+class MappedCandleFile {
+public:
+	// columns of consecutive rows
+	struct Rows {
+		std::span<const std::int64_t> time;
+		std::span<const std::int64_t> tick_count;
+		std::span<const double> open;
+		std::span<const double> high;
+		std::span<const double> low;
+		std::span<const double> close;
+
+		std::size_t
+		size() const { return time.size(); }
+	};
+
+	explicit
+	MappedCandleFile(const std::filesystem::path& path) {
+		const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) fail(path, "open");
+
+		struct stat st{};
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			fail(path, "stat");
+		}
+
+		size = static_cast<std::size_t>(st.st_size);
+		if (size < sizeof(CandleFileHeader)) {
+			::close(fd);
+			throw std::runtime_error("Not a candle file: " + path.string());
+		}
+
+		void* at = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (at == MAP_FAILED) fail(path, "mmap");
+
+		base = static_cast<const char*>(at);
+		try {
+			validate(path);
+		} catch (...) {
+			::munmap(at, size);
+			throw;
+		}
+	}
+
+	MappedCandleFile(MappedCandleFile&& other) noexcept:
+		base(std::exchange(other.base, nullptr)), size(std::exchange(other.size, 0)) {}
+
+	MappedCandleFile(const MappedCandleFile&) = delete;
+
+	MappedCandleFile&
+	operator=(const MappedCandleFile&) = delete;
+
+	MappedCandleFile&
+	operator=(MappedCandleFile&&) = delete;
+
+	~MappedCandleFile() {
+		if (base) ::munmap(const_cast<char*>(base), size);
+	}
+
+	const CandleFileHeader&
+	header() const { return *reinterpret_cast<const CandleFileHeader*>(base); }
+
+	Rows
+	all() const { return rows(0, header().count); }
+
+	// rows with from <= time <= to
+	Rows
+	between(std::int64_t from, std::int64_t to) const {
+		const auto first = lower_bound(from);
+		const auto last = to == INT64_MAX ? header().count : lower_bound(to + 1);
+		return rows(first, std::max(first, last));
+	}
+
+	// position of the first row with time >= t, found through the sparse
+	// index and a search inside one stride
+	std::size_t
+	lower_bound(std::int64_t t) const {
+		const auto& h = header();
+		const auto index = column<std::int64_t>(SECTION_INDEX, h.index_count);
+		const auto time = column<std::int64_t>(SECTION_TIME, h.count);
+
+		const auto k = static_cast<std::size_t>(std::upper_bound(index.begin(), index.end(), t) - index.begin());
+		const auto lo = k == 0 ? 0 : (k - 1) * h.index_stride;
+		const auto hi = std::min<std::size_t>(k * h.index_stride, h.count);
+
+		return static_cast<std::size_t>(std::lower_bound(time.begin() + lo, time.begin() + hi, t) - time.begin());
+	}
+
+private:
+	const char* base = nullptr;
+	std::size_t size = 0;
+
+	[[noreturn]] static void
+	fail(const std::filesystem::path& path, const char* what) {
+		throw std::runtime_error(std::string("Failed to ") + what + " " + path.string() + ": " + std::strerror(errno));
+	}
+
+	template<typename T>
+	std::span<const T>
+	column(std::size_t section, std::size_t count) const {
+		return { reinterpret_cast<const T*>(base + header().offsets[section]), count };
+	}
+
+	Rows
+	rows(std::size_t first, std::size_t last) const {
+		const auto count = header().count;
+		const auto n = last - first;
+
+		return Rows {
+			.time       = column<std::int64_t>(SECTION_TIME, count).subspan(first, n),
+			.tick_count = column<std::int64_t>(SECTION_TICK_COUNT, count).subspan(first, n),
+			.open       = column<double>(SECTION_OPEN, count).subspan(first, n),
+			.high       = column<double>(SECTION_HIGH, count).subspan(first, n),
+			.low        = column<double>(SECTION_LOW, count).subspan(first, n),
+			.close      = column<double>(SECTION_CLOSE, count).subspan(first, n),
+		};
+	}
+
+	void
+	validate(const std::filesystem::path& path) const {
+		const auto& h = header();
+		auto bad = [&](const char* why) {
+			return std::runtime_error("Bad candle file " + path.string() + ": " + why);
+		};
+
+		if (std::memcmp(h.magic, CANDLE_FILE_MAGIC, sizeof(h.magic)) != 0) throw bad("magic");
+		if (h.version != CANDLE_FILE_VERSION) throw bad("version");
+		if (h.endian != CANDLE_FILE_ENDIAN) throw bad("written with another byte order");
+		if (h.index_stride == 0) throw bad("index stride");
+
+		const auto expected = candle_file_layout(h.frame, h.count, h.index_stride);
+		if (h.index_count != expected.index_count
+			|| std::memcmp(h.offsets, expected.offsets, sizeof(h.offsets)) != 0
+			|| h.file_size != expected.file_size)
+		{
+			throw bad("layout");
+		}
+		if (h.file_size > size) throw bad("truncated");
+	}
+};
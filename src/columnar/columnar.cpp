@@ -0,0 +1,278 @@
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "duckdb.hpp"
+
+#include "columnar.h"
+
+namespace {
+
+[[noreturn]] void
+fail(const fs::path& path, const char* what) {
+	throw std::runtime_error(std::string("Failed to ") + what + " " + path.string() + ": " + std::strerror(errno));
+}
+
+// Writable mapping of a new file, synced to disk by finish().
+class OutputMap {
+public:
+	OutputMap(const fs::path& path, std::size_t size): path(path), size(size) {
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0) fail(path, "create");
+
+		if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+			::close(fd);
+			fail(path, "size");
+		}
+
+		void* at = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (at == MAP_FAILED) {
+			::close(fd);
+			fail(path, "mmap");
+		}
+		base = static_cast<char*>(at);
+	}
+
+	OutputMap(const OutputMap&) = delete;
+
+	OutputMap&
+	operator=(const OutputMap&) = delete;
+
+	~OutputMap() {
+		if (base) ::munmap(base, size);
+		if (fd >= 0) ::close(fd);
+	}
+
+	template<typename T>
+	T*
+	at(std::uint64_t offset) { return reinterpret_cast<T*>(base + offset); }
+
+	void
+	finish() {
+		::munmap(base, size);
+		base = nullptr;
+
+		if (::fsync(fd) != 0) fail(path, "sync");
+		::close(fd);
+		fd = -1;
+	}
+
+private:
+	fs::path path;
+	std::size_t size;
+	int fd = -1;
+	char* base = nullptr;
+};
+
+// makes a rename inside dir durable
+void
+sync_dir(const fs::path& dir) {
+	const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) fail(dir, "open");
+
+	const bool ok = ::fsync(fd) == 0;
+	::close(fd);
+	if (!ok) fail(dir, "sync");
+}
+
+}
+
+fs::path
+candle_file_path(const fs::path& dir, const std::string& symbol, std::int64_t frame) {
+	return dir / (symbol + "_" + std::to_string(frame) + "ms.candles");
+}
+
+std::size_t
+write_candle_file(const fs::path& path, std::int64_t frame, std::span<const Candle> candles) {
+	for (std::size_t i = 1; i < candles.size(); ++i) {
+		if (candles[i].time <= candles[i - 1].time) {
+			throw std::invalid_argument("candles are not in ascending time order: " + std::to_string(candles[i].time));
+		}
+	}
+
+	std::optional<MappedCandleFile> existing{};
+	if (fs::exists(path)) {
+		existing.emplace(path);
+		if (existing->header().frame != frame) {
+			throw std::runtime_error(
+				path.string() + " holds " + std::to_string(existing->header().frame) + "ms candles, not "
+				+ std::to_string(frame) + "ms"
+			);
+		}
+	}
+
+	const auto old = existing ? existing->all() : MappedCandleFile::Rows{};
+
+	// sizes first: the layout depends on the merged row count
+	std::size_t count = 0;
+	for (std::size_t i = 0, j = 0; i < old.size() || j < candles.size(); ++count) {
+		if (j == candles.size() || (i < old.size() && old.time[i] < candles[j].time)) ++i;
+		else if (i == old.size() || candles[j].time < old.time[i]) ++j;
+		else ++i, ++j;
+	}
+
+	auto header = candle_file_layout(frame, count, CANDLE_FILE_STRIDE);
+	const auto tmp = fs::path(path.string() + ".tmp");
+
+	try {
+		OutputMap out(tmp, header.file_size);
+
+		auto* time = out.at<std::int64_t>(header.offsets[SECTION_TIME]);
+		auto* tick_count = out.at<std::int64_t>(header.offsets[SECTION_TICK_COUNT]);
+		auto* open = out.at<double>(header.offsets[SECTION_OPEN]);
+		auto* high = out.at<double>(header.offsets[SECTION_HIGH]);
+		auto* low = out.at<double>(header.offsets[SECTION_LOW]);
+		auto* close = out.at<double>(header.offsets[SECTION_CLOSE]);
+
+		std::size_t row = 0;
+		auto put = [&](std::int64_t t, std::int64_t n, double o, double h, double l, double c) {
+			time[row] = t;
+			tick_count[row] = n;
+			open[row] = o;
+			high[row] = h;
+			low[row] = l;
+			close[row] = c;
+			++row;
+		};
+
+		for (std::size_t i = 0, j = 0; i < old.size() || j < candles.size();) {
+			if (j == candles.size() || (i < old.size() && old.time[i] < candles[j].time)) {
+				put(old.time[i], old.tick_count[i], old.open[i], old.high[i], old.low[i], old.close[i]);
+				++i;
+				continue;
+			}
+
+			// new rows win over old ones of the same time
+			if (i < old.size() && old.time[i] == candles[j].time) ++i;
+
+			const auto& c = candles[j++];
+			put(c.time, c.tick_count, c.open, c.high, c.low, c.close);
+		}
+
+		auto* index = out.at<std::int64_t>(header.offsets[SECTION_INDEX]);
+		for (std::uint64_t k = 0; k < header.index_count; ++k) {
+			index[k] = time[k * header.index_stride];
+		}
+
+		if (count) {
+			header.first_time = time[0];
+			header.last_time = time[count - 1];
+		}
+		std::memcpy(out.at<char>(0), &header, sizeof(header));
+
+		out.finish();
+		fs::rename(tmp, path);
+	} catch (...) {
+		std::error_code ignored;
+		fs::remove(tmp, ignored);
+		throw;
+	}
+
+	sync_dir(path.parent_path().empty() ? fs::path{"."} : path.parent_path());
+	return count;
+}
+
+namespace {
+
+// Merges the candles of candles_<symbol> with from <= time <= to into the
+// candle file under dir.
+std::size_t
+export_between(	const Settings& settings,
+				const fs::path& dir,
+				std::int64_t from,
+				std::int64_t to,
+				spdlog::logger& logger)
+{
+	duckdb::DuckDB db(settings.db_path);
+	duckdb::Connection connection(db);
+
+	std::string sql = "SELECT time, volume, open, high, low, close FROM candles_" + settings.symbol;
+	if (from != INT64_MIN || to != INT64_MAX) {
+		sql += " WHERE time BETWEEN " + std::to_string(from) + " AND " + std::to_string(to);
+	}
+	sql += " ORDER BY time";
+
+	auto res = connection.Query(sql);
+	if (res->HasError()) {
+		throw std::runtime_error("Failed to read candles_" + settings.symbol + ": " + res->GetError());
+	}
+
+	static constexpr const char* COLUMNS[] = { "time", "volume", "open", "high", "low", "close" };
+
+	std::vector<Candle> candles{};
+	candles.reserve(res->RowCount());
+
+	while (auto chunk = res->Fetch()) {
+		chunk->Flatten();
+
+		// the file has no notion of NULL, so such a row cannot be exported
+		for (duckdb::idx_t c = 0; c < chunk->ColumnCount(); ++c) {
+			if (duckdb::FlatVector::Validity(chunk->data[c]).AllValid()) continue;
+
+			for (duckdb::idx_t i = 0; i < chunk->size(); ++i) {
+				if (!duckdb::FlatVector::IsNull(chunk->data[c], i)) continue;
+				throw std::runtime_error(
+					"candles_" + settings.symbol + " has a NULL " + COLUMNS[c] + " at "
+					+ chunk->GetValue(0, i).ToString()
+				);
+			}
+		}
+
+		const auto* time = duckdb::FlatVector::GetData<std::int64_t>(chunk->data[0]);
+		const auto* volume = duckdb::FlatVector::GetData<std::int64_t>(chunk->data[1]);
+		const auto* open = duckdb::FlatVector::GetData<double>(chunk->data[2]);
+		const auto* high = duckdb::FlatVector::GetData<double>(chunk->data[3]);
+		const auto* low = duckdb::FlatVector::GetData<double>(chunk->data[4]);
+		const auto* close = duckdb::FlatVector::GetData<double>(chunk->data[5]);
+
+		for (std::size_t i = 0; i < chunk->size(); ++i) {
+			candles.push_back(Candle {
+				.time = time[i],
+				.tick_count = volume[i],
+				.open = open[i],
+				.high = high[i],
+				.low = low[i],
+				.close = close[i],
+			});
+		}
+	}
+
+	fs::create_directories(dir);
+	const auto path = candle_file_path(dir, settings.symbol, settings.frame);
+	const auto rows = write_candle_file(path, settings.frame, candles);
+
+	logger.info("Exported {} candles into {} ({} rows)", candles.size(), path.string(), rows);
+	return rows;
+}
+
+}
+
+std::size_t
+export_candle_file(const Settings& settings, const fs::path& dir, spdlog::logger& logger) {
+	return export_between(settings, dir, settings.range.first_ms(), settings.range.last_ms(), logger);
+}
+
+std::size_t
+export_written_candles(	const Settings& settings,
+						const fs::path& dir,
+						const CandleSpan& written,
+						spdlog::logger& logger)
+{
+	// a file that does not exist yet gets the whole history first
+	if (!fs::exists(candle_file_path(dir, settings.symbol, settings.frame))) {
+		return export_between(settings, dir, INT64_MIN, INT64_MAX, logger);
+	}
+
+	if (written.empty()) {
+		logger.info("No candles written, nothing to export");
+		return 0;
+	}
+
+	return export_between(settings, dir, written.first, written.last, logger);
+}
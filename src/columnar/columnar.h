@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "./candle_file.h"
+#include "../pipeline/pipeline.h"
+
+namespace fs = std::filesystem;
+
+// rows between two index entries of a written file
+inline constexpr std::uint64_t CANDLE_FILE_STRIDE = 1024;
+
+// <dir>/<symbol>_<frame>ms.candles
+fs::path
+candle_file_path(const fs::path& dir, const std::string& symbol, std::int64_t frame);
+
+// Merges candles (ascending, unique time) into the file at path: rows of
+// the same time are replaced, the rest kept. The result is written next to
+// it and renamed over it, so readers mapping the old file are unaffected.
+// Throws when the existing file has another frame. Returns the row count.
+std::size_t
+write_candle_file(const fs::path& path, std::int64_t frame, std::span<const Candle> candles);
+
+// Exports candles_<symbol> from settings.db_path, limited to settings.range
+// when it is bounded, into its candle file under dir. Throws on NULL values.
+std::size_t
+export_candle_file(const Settings& settings, const fs::path& dir, spdlog::logger& logger);
+
+// Exports only the candles within written, as returned by write_stage, so a
+// run costs what it wrote rather than the whole table; a candle file that
+// does not exist yet is exported in full. Returns the file's row count, or
+// 0 when nothing was written.
+std::size_t
+export_written_candles(	const Settings& settings,
+						const fs::path& dir,
+						const CandleSpan& written,
+						spdlog::logger& logger);
@@ -17,7 +17,7 @@ namespace {
 int
 inflate_chunk(	z_stream& stream,
 				std::ostream& out,
-				std::vector<unsigned char>& out_buf)
+				const BufferPool::Buffer& out_buf)
 {
 	stream.next_out = out_buf.data();
 	stream.avail_out = static_cast<uInt>(out_buf.size());
@@ -35,59 +35,93 @@ inflate_chunk(	z_stream& stream,
 
 }
 
+GzipInflater::GzipInflater(std::ostream& out, bool concatenated):
+	out(out), out_buf(BufferPool::instance().acquire()), concatenated(concatenated)
+{
+	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+		throw std::runtime_error("inflateInit2 failed");
+	}
+}
+
+GzipInflater::~GzipInflater() {
+	inflateEnd(&stream);
+}
+
 void
+GzipInflater::write(const char* data, size_t size) {
+	stream.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream.avail_in = static_cast<uInt>(size);
+
+	while (stream.avail_in > 0) {
+		if (done) {
+			if (!concatenated) break;
+
+			// total_in and total_out keep counting across members
+			const auto in = stream.total_in;
+			const auto produced = stream.total_out;
+			if (inflateReset(&stream) != Z_OK) throw std::runtime_error("inflateReset failed");
+
+			stream.total_in = in;
+			stream.total_out = produced;
+			done = false;
+		}
+
+		int ret = inflate_chunk(stream, out, out_buf);
+		if (ret < 0) {
+			throw std::runtime_error(
+				"gunzip failed after " + std::to_string(stream.total_in) + " bytes: "
+				+ (stream.msg ? stream.msg : std::to_string(ret))
+			);
+		}
+
+		done = (ret == Z_STREAM_END);
+	}
+}
+
+bool
 decompress_gzip(std::istream& in,
 				std::ostream& out,
 				spdlog::logger& logger)
 {
-	z_stream stream{};
-	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
-		logger.error("inflateInit2 failed");
-		return;
+	std::unique_ptr<GzipInflater> inflater;
+	try {
+		inflater = std::make_unique<GzipInflater>(out);
+	} catch (const std::exception& e) {
+		logger.error(e.what());
+		return false;
 	}
 
-	// 1 MB of data at a time
-	std::vector<unsigned char>  in_buf(1 << 20);
-	std::vector<unsigned char> out_buf(1 << 20);
-
-	int ret = Z_OK;
-	size_t total_in  = 0;
-	size_t total_out = 0;
+	// one pool buffer (1 MB) of data at a time
+	auto in_buf = BufferPool::instance().acquire();
+	auto* in_data = reinterpret_cast<char*>(in_buf.data());
 
-	while (ret != Z_STREAM_END) {
-		in.read((char*)in_buf.data(), in_buf.size());
+	while (!inflater->finished()) {
+		in.read(in_data, in_buf.size());
 
 		auto got = in.gcount();
 		if (got <= 0) break;
 
-		total_in += static_cast<size_t>(got);
-
-		stream.next_in  = in_buf.data();
-		stream.avail_in = static_cast<uInt>(got);
-
-		while (stream.avail_in > 0 && ret != Z_STREAM_END) {
-			size_t before = stream.total_out;
- 
-			ret = inflate_chunk(stream, out, out_buf);
-			if (ret < 0) break;
-
-			total_out += (stream.total_out - before);
+		try {
+			inflater->write(in_data, static_cast<size_t>(got));
+		} catch (const std::exception& e) {
+			logger.error(e.what());
+			return false;
 		}
 	}
 
-	inflateEnd(&stream);
-
-	if (ret != Z_STREAM_END) {
+	if (!inflater->finished()) {
 		logger.error(
 			"gunzip stream ended prematurely (in={} bytes)",
-			total_in
+			inflater->total_in()
 		);
-		return;
+		return false;
 	}
 
 	logger.info(
 		"gzip decompression finished ({} → {} bytes)",
-		total_in,
-		total_out
+		inflater->total_in(),
+		inflater->total_out()
 	);
-}
\ No newline at end of file
+
+	return true;
+}
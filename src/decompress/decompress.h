@@ -2,12 +2,55 @@
 #include <istream>
 #include <ostream>
 #include <memory>
+#include <vector>
+
+#include <zlib.h>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
+#include "../memory/buffer_pool.h"
+
+// Push-style gunzip: compressed bytes go in through write() as they arrive
+// and the inflated data is written to out. With concatenated set, bytes after
+// the end of a gzip member start the next one (gzip -c a >> b style files).
+class GzipInflater {
+public:
+	explicit
+	GzipInflater(std::ostream& out, bool concatenated = false);
+
+	GzipInflater(const GzipInflater&) = delete;
+
+	GzipInflater&
+	operator=(const GzipInflater&) = delete;
+
+	~GzipInflater();
+
+	// throws on corrupt input; bytes after the end of the stream are ignored
+	// unless concatenated
+	void
+	write(const char* data, size_t size);
+
+	// the last member ended
+	bool
+	finished() const { return done; }
+
+	size_t
+	total_in() const { return stream.total_in; }
+
+	size_t
+	total_out() const { return stream.total_out; }
+
+private:
+	z_stream stream{};
+	std::ostream& out;
+	BufferPool::Buffer out_buf;
+	bool concatenated;
+	bool done = false;
+};
 
-void
+// returns false when the gzip stream is corrupt or truncated
+bool
 decompress_gzip(std::istream& in,
 				std::ostream& out,
 				spdlog::logger& logger);
\ No newline at end of file
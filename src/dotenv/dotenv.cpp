@@ -34,4 +34,21 @@ load_dotenv(const std::string& path) {
         setenv(key.c_str(), val.c_str(), 1);
 #endif
     }
+}
+
+bool
+env_flag(const std::string& name) {
+    const char* val = std::getenv(name.c_str());
+    if (!val) return false;
+
+    const std::string s = val;
+    return s == "1" || s == "true" || s == "yes" || s == "on";
+}
+
+long long
+env_number(const std::string& name, long long fallback) {
+    const char* val = std::getenv(name.c_str());
+    if (!val || !*val) return fallback;
+
+    return std::stoll(val);
 }
\ No newline at end of file
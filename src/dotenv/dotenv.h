@@ -2,4 +2,12 @@
 #include <string>
 
 void
-load_dotenv(const std::string& path);
\ No newline at end of file
+load_dotenv(const std::string& path);
+
+// true when the variable is set to 1/true/yes/on
+bool
+env_flag(const std::string& name);
+
+// fallback when the variable is unset or empty
+long long
+env_number(const std::string& name, long long fallback);
\ No newline at end of file
@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "follow.h"
+#include "tail_source.h"
+#include "../decompress/decompress.h"
+#include "../ftp/ftp_client.h"
+#include "../transform/transform.h"
+#include "../writer/writer.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void
+on_stop(int) {
+	stop_requested = 1;
+}
+
+void
+install_stop_handlers() {
+	struct sigaction action{};
+	action.sa_handler = on_stop;
+	sigemptyset(&action.sa_mask);
+
+	// no SA_RESTART, so a signal cuts the inotify wait short
+	::sigaction(SIGINT, &action, nullptr);
+	::sigaction(SIGTERM, &action, nullptr);
+}
+
+// inotify over a few directories; wait() returns the files written or moved
+// into them since the last call
+class DirWatcher {
+public:
+	DirWatcher() {
+		fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) throw std::runtime_error("inotify_init1 failed: " + std::string(std::strerror(errno)));
+	}
+
+	DirWatcher(const DirWatcher&) = delete;
+
+	DirWatcher&
+	operator=(const DirWatcher&) = delete;
+
+	~DirWatcher() { ::close(fd); }
+
+	void
+	add(const fs::path& dir, std::uint32_t mask) {
+		const int wd = ::inotify_add_watch(fd, dir.c_str(), mask);
+		if (wd < 0) throw std::runtime_error("inotify_add_watch failed for " + dir.string());
+
+		dirs[wd] = dir;
+	}
+
+	std::vector<fs::path>
+	wait(int timeout_ms) {
+		pollfd p { .fd = fd, .events = POLLIN, .revents = 0 };
+
+		if (::poll(&p, 1, timeout_ms) < 0) {
+			if (errno == EINTR) return {};
+			throw std::runtime_error("poll failed: " + std::string(std::strerror(errno)));
+		}
+
+		std::vector<fs::path> changed{};
+		alignas(inotify_event) char buf[4096];
+
+		while (true) {
+			const auto len = ::read(fd, buf, sizeof(buf));
+			if (len <= 0) break;
+
+			for (char* at = buf; at < buf + len;) {
+				const auto* event = reinterpret_cast<const inotify_event*>(at);
+				if (event->mask & IN_Q_OVERFLOW) overflowed = true;
+				if (event->len) changed.push_back(dirs[event->wd] / event->name);
+
+				at += sizeof(inotify_event) + event->len;
+			}
+		}
+
+		return changed;
+	}
+
+	// true once after the kernel dropped events
+	bool
+	take_overflow() { return std::exchange(overflowed, false); }
+
+private:
+	int fd = -1;
+	std::map<int, fs::path> dirs;
+	bool overflowed = false;
+};
+
+struct HourFile {
+	std::uint32_t hour;		// yyyymmddhh
+	Side side;
+	std::string name;
+};
+
+std::vector<HourFile>
+hour_files(const std::vector<std::string>& names, const std::string& symbol, std::uint32_t from) {
+	std::vector<HourFile> out{};
+
+	for (const auto& name : names) {
+		const auto parsed = parse_file_name(name);
+		if (!parsed || parsed->symbol != symbol) continue;
+
+		const std::uint32_t hour = parsed->date * 100 + parsed->hour;
+		if (hour >= from) out.push_back(HourFile { hour, parsed->side, name });
+	}
+
+	// older hours first: a side only moves on to the next hour once it is
+	// there, so the final copy of the previous one has to land before it
+	std::sort(out.begin(), out.end(), [](const HourFile& a, const HourFile& b) {
+		return a.hour < b.hour;
+	});
+
+	return out;
+}
+
+// the newest hour present on both sides
+std::uint32_t
+newest_common_hour(const std::vector<HourFile>& files) {
+	std::uint32_t ask = 0, bid = 0;
+
+	for (const auto& file : files) {
+		auto& newest = file.side == Side::Ask ? ask : bid;
+		newest = std::max(newest, file.hour);
+	}
+
+	return std::min(ask, bid);
+}
+
+// Inflated files appear by rename, so a TailTickSource never opens a half
+// written hour; what is appended to them later it follows in place. The
+// temporary name starts with a dot and so never parses as the symbol.
+fs::path
+temp_path(const fs::path& dir, const std::string& name) {
+	return dir / ("." + name + ".part");
+}
+
+// Fetches hour files as they grow on the server. A file seen before only has
+// its new bytes downloaded (REST) and pushed through the inflater that
+// decompressed the earlier ones, appending to the hour file in place; the
+// first fetch, or one whose file shrank or would not resume, downloads it
+// whole and renames it into place.
+class FtpPoller {
+public:
+	FtpPoller(const Settings& settings, std::uint32_t from):
+		settings(settings), from(from)
+	{
+		client.connect(settings.ftp);
+	}
+
+	void
+	start_at(std::uint32_t hour) { from = hour; }
+
+	std::vector<HourFile>
+	list() const {
+		return hour_files(client.list_files(settings.symbol), settings.symbol, from);
+	}
+
+	void
+	poll(spdlog::logger& logger) {
+		const auto files = list();
+
+		for (const auto& file : files) {
+			const auto size = client.remote_size(settings.symbol, file.name);
+
+			auto known = fetched.find(file.name);
+			if (known != fetched.end()) {
+				auto& growing = known->second;
+				if (size >= 0 && size == growing.size) continue;
+
+				if (size > growing.size) {
+					try {
+						append(file.name, growing);
+						logger.info("Fetched {} up to {} bytes compressed", file.name, growing.size);
+						continue;
+					} catch (const std::exception& e) {
+						logger.warn("Resuming {} failed, fetching it whole: {}", file.name, e.what());
+					}
+				}
+
+				fetched.erase(known);
+			}
+
+			const auto tmp = temp_path(settings.unzipped_dir, file.name);
+			auto [added, _] = fetched.try_emplace(file.name, tmp);
+
+			try {
+				append(file.name, added->second);
+				fs::rename(tmp, settings.unzipped_dir / fs::path(file.name).stem());
+			} catch (...) {
+				fetched.erase(added);
+				fs::remove(tmp);
+				throw;
+			}
+
+			logger.info("Fetched {} ({} bytes compressed)", file.name, added->second.size);
+		}
+
+		// hours before the newest common one will not change any more once
+		// they were fetched after it appeared, i.e. in this poll
+		if (auto newest = newest_common_hour(files)) from = std::max(from, newest);
+		std::erase_if(fetched, [&](const auto& entry) {
+			const auto parsed = parse_file_name(entry.first);
+			return !parsed || parsed->date * 100 + parsed->hour < from;
+		});
+	}
+
+private:
+	// an hour file being inflated as its compressed copy grows; out stays
+	// open across the rename into place
+	struct Growing {
+		explicit
+		Growing(const fs::path& path): out(path, std::ios::binary), inflater(out, true) {
+			if (!out) throw std::runtime_error("failed to open output: " + path.string());
+		}
+
+		std::ofstream out;
+		GzipInflater inflater;
+		std::int64_t size = 0;		// compressed bytes inflated so far
+	};
+
+	const Settings& settings;
+	FtpClient client;
+
+	std::uint32_t from;
+	std::unordered_map<std::string, Growing> fetched;
+
+	void
+	append(const std::string& name, Growing& growing) {
+		growing.size += client.download_appended(settings.symbol, name, growing.size, growing.inflater);
+
+		growing.out.flush();
+		if (!growing.out) throw std::runtime_error("failed to write inflated " + name);
+	}
+};
+
+void
+inflate_local(const Settings& settings, const fs::path& gz_path, spdlog::logger& logger) {
+	const auto name = gz_path.filename().string();
+	const auto tmp = temp_path(settings.unzipped_dir, name);
+
+	std::ifstream in(gz_path, std::ios::binary);
+	if (!in) return;	// already moved away again
+
+	std::ofstream out(tmp, std::ios::binary);
+	if (!out) throw std::runtime_error("failed to open output: " + tmp.string());
+
+	const bool ok = decompress_gzip(in, out, logger);
+	out.close();
+
+	if (!ok) {
+		fs::remove(tmp);
+		return;
+	}
+
+	fs::rename(tmp, settings.unzipped_dir / gz_path.stem());
+}
+
+// Saves closed candles and the open one through one CandleWriter kept open
+// for the whole session, committing at most once per commit_every. A failed
+// commit is logged and retried on the next interval with its candles kept;
+// a writer that fails is reopened then.
+class CandleSink {
+public:
+	CandleSink(const Settings& settings, std::chrono::milliseconds commit_every):
+		settings(settings), interval(commit_every) {}
+
+	void
+	drain(AskBidMerger& merger, spdlog::logger& logger) {
+		Candle candle{};
+		while (merger.get_next_candle(candle)) unsaved.push_back(candle);
+
+		const auto* open = merger.open_candle();
+		const bool open_changed = open
+			&& (open->time != saved_open.time || open->tick_count != saved_open.tick_count);
+
+		if (unsaved.empty() && !open_changed) return;
+		if (Clock::now() < next_commit) return;
+
+		next_commit = Clock::now() + interval;
+
+		batch.assign(unsaved.begin(), unsaved.end());
+		if (open) batch.push_back(*open);
+
+		try {
+			if (!writer) writer = std::make_unique<CandleWriter>(settings.db_path, settings.symbol, settings.storage);
+
+			writer->append(batch);
+			writer->commit();
+		} catch (const std::exception& e) {
+			writer.reset();
+			logger.warn("Saving {} candle(s) failed, retrying: {}", batch.size(), e.what());
+			return;
+		}
+
+		logger.info(
+			"Upserted {} closed candle(s), open candle time={} ticks={}",
+			unsaved.size(),
+			open ? open->time : -1,
+			open ? open->tick_count : 0
+		);
+
+		unsaved.clear();
+		if (open) saved_open = *open;
+	}
+
+private:
+	const Settings& settings;
+	std::chrono::milliseconds interval;
+	Clock::time_point next_commit{};
+
+	std::unique_ptr<CandleWriter> writer;
+
+	std::vector<Candle> unsaved;	// closed since the last commit
+	std::vector<Candle> batch;
+	Candle saved_open{};
+};
+
+}
+
+void
+follow_stage(const Settings& settings, spdlog::logger& logger) {
+	const auto& symbol = settings.symbol;
+
+	fs::create_directories(settings.download_dir);
+	fs::create_directories(settings.unzipped_dir);
+
+	std::uint32_t start = settings.range.first;
+	FtpPoller poller{settings, start};
+
+	if (start == 0) {
+		start = newest_common_hour(poller.list());
+		if (start == 0) throw std::runtime_error("no hour files on the server for " + symbol);
+
+		poller.start_at(start);
+	}
+
+	logger.info("Following {} from {}", symbol, start);
+
+	DirWatcher watcher{};
+	// only finished .gz files are inflated; hour files are also followed
+	// while they grow in place
+	watcher.add(settings.download_dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	watcher.add(settings.unzipped_dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY);
+
+	auto ask = std::make_unique<TailTickSource>(settings.unzipped_dir, symbol, Side::Ask, start);
+	auto bid = std::make_unique<TailTickSource>(settings.unzipped_dir, symbol, Side::Bid, start);
+
+	// the merger owns the sources; the loop keeps telling them about new hours
+	TailTickSource* tails[] = { ask.get(), bid.get() };
+
+	AskBidMerger merger { std::move(ask), std::move(bid), settings.frame };
+	merger.set_live(true);
+
+	const auto interval = std::chrono::milliseconds(settings.follow_poll_ms);
+
+	CandleSink sink{settings, interval};
+	install_stop_handlers();
+
+	auto next_poll = Clock::now();
+
+	while (!stop_requested) {
+		if (Clock::now() >= next_poll) {
+			// a failed poll is retried on the next interval
+			try {
+				poller.poll(logger);
+			} catch (const std::exception& e) {
+				logger.warn("FTP poll failed: {}", e.what());
+			}
+			next_poll = Clock::now() + interval;
+		}
+
+		const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_poll - Clock::now());
+		for (const auto& path : watcher.wait(static_cast<int>(std::max<long long>(wait.count(), 0)))) {
+			for (auto* tail : tails) tail->notice(path);
+			if (path.parent_path() != settings.download_dir || path.extension() != ".gz") continue;
+
+			const auto parsed = parse_file_name(path.filename().string());
+			if (!parsed || parsed->symbol != symbol || parsed->date * 100 + parsed->hour < start) continue;
+
+			inflate_local(settings, path, logger);
+		}
+
+		if (watcher.take_overflow()) {
+			logger.warn("Missed file events, rescanning {}", settings.unzipped_dir.string());
+			for (auto* tail : tails) tail->rescan();
+		}
+
+		sink.drain(merger, logger);
+	}
+
+	logger.info("Stopped following {}", symbol);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include "../pipeline/pipeline.h"
+
+// Tails the newest hours of settings.symbol until SIGINT or SIGTERM. It starts
+// at RANGE_FROM, or else at the newest hour present on both sides, and:
+//  - polls the FTP listing every follow_poll_ms and fetches hour files whose
+//    size changed into DECOMPRESSED_FOLDER, downloading and inflating only
+//    the bytes added since the previous fetch
+//  - inflates .gz files that appear in FTP_DOWNLOAD_FOLDER/<symbol>
+//  - on every change in DECOMPRESSED_FOLDER parses the appended bytes with one
+//    live AskBidMerger, and upserts the newly closed candles and the open one
+//    at most every follow_poll_ms through a writer held open on DB_PATH
+void
+follow_stage(const Settings& settings, spdlog::logger& logger);
@@ -0,0 +1,160 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tail_source.h"
+
+TailTickSource::TailTickSource(const fs::path& dir, std::string symbol, Side side, std::uint32_t first_hour):
+	dir(dir), symbol(std::move(symbol)), side(side), first_hour(first_hour)
+{
+	rescan();
+}
+
+TailTickSource::~TailTickSource() {
+	if (fd >= 0) ::close(fd);
+}
+
+size_t
+TailTickSource::read(TickEntry* out, size_t capacity) {
+	size_t n = 0;
+
+	while (n < capacity) {
+		if (pos < pending.size()) {
+			const auto nl = pending.find('\n', pos);
+
+			if (nl != std::string::npos) {
+				if (parse_tick_line(std::string_view(pending).substr(pos, nl - pos), out[n])) ++n;
+				pos = nl + 1;
+				continue;
+			}
+		}
+
+		// only a partial line is left, keep it for the next bytes
+		pending.erase(0, pos);
+		pos = 0;
+
+		if (!refill()) break;
+	}
+
+	return n;
+}
+
+bool
+TailTickSource::refill() {
+	std::string name{};
+
+	if (fd < 0) {
+		const auto next = find_next(name);
+		if (next == 0) return false;
+
+		open_hour(next, name);
+	}
+
+	reopen_if_replaced();
+
+	const auto size = pending.size();
+	pending.resize(size + READ_SIZE);
+
+	ssize_t got;
+	do {
+		got = ::pread(fd, pending.data() + size, READ_SIZE, offset);
+	} while (got < 0 && errno == EINTR);
+
+	if (got < 0) {
+		pending.resize(size);
+		throw std::runtime_error("Failed to read " + path.string() + ": " + std::strerror(errno));
+	}
+
+	pending.resize(size + static_cast<size_t>(got));
+	if (got > 0) {
+		offset += got;
+		return true;
+	}
+
+	// The next hour only shows up after this one was downloaded for the
+	// last time, so look for it first and then re-check this file.
+	const auto next = find_next(name);
+	if (next == 0) return false;
+	if (reopen_if_replaced()) return true;
+
+	// a finished file may end without a newline
+	if (!pending.empty()) pending.push_back('\n');
+
+	open_hour(next, name);
+	return true;
+}
+
+bool
+TailTickSource::reopen_if_replaced() {
+	struct stat st{};
+	if (::stat(path.c_str(), &st) != 0 || st.st_ino == inode) return false;
+
+	if (st.st_size < offset) {
+		throw std::runtime_error(path.string() + " was replaced by a shorter file");
+	}
+
+	const int replaced = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (replaced < 0) return false;
+
+	::close(fd);
+	fd = replaced;
+	inode = st.st_ino;
+
+	return true;
+}
+
+void
+TailTickSource::notice(const fs::path& file) {
+	if (file.parent_path() != dir) return;
+
+	const auto name = file.filename().string();
+	if (name.ends_with(".gz")) return;
+
+	const auto parsed = parse_file_name(name);
+	if (!parsed || parsed->side != side || parsed->symbol != symbol) return;
+
+	const std::uint32_t hour = parsed->date * 100 + parsed->hour;
+	if (current ? hour <= current : hour < first_hour) return;
+
+	later[hour] = name;
+}
+
+void
+TailTickSource::rescan() {
+	later.clear();
+	for (const auto& entry : fs::directory_iterator(dir)) notice(entry.path());
+}
+
+std::uint32_t
+TailTickSource::find_next(std::string& name) {
+	// hours up to the current one were either followed or skipped
+	later.erase(later.begin(), current ? later.upper_bound(current) : later.lower_bound(first_hour));
+	if (later.empty()) return 0;
+
+	name = later.begin()->second;
+	return later.begin()->first;
+}
+
+void
+TailTickSource::open_hour(std::uint32_t hour, const std::string& name) {
+	const auto next_path = dir / name;
+
+	const int next_fd = ::open(next_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (next_fd < 0) throw std::runtime_error("Failed to open " + next_path.string());
+
+	struct stat st{};
+	::fstat(next_fd, &st);
+
+	if (fd >= 0) ::close(fd);
+
+	fd = next_fd;
+	inode = st.st_ino;
+	offset = 0;
+
+	path = next_path;
+	current = hour;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include <sys/types.h>
+
+#include "../planner/planner.h"
+#include "../transform/tick_source.h"
+
+namespace fs = std::filesystem;
+
+// Follows one side's hour files in dir while they grow. Each read() parses
+// only the bytes appended since the previous one, and once the current file
+// has nothing new and a later hour of the same symbol and side exists, the
+// stream carries on in that file. A file replaced by rename (a fresh
+// download of the same hour) is reopened at the same offset, since the new
+// copy extends the old one.
+//
+// Later hours are looked up in a list built by one scan of dir and kept up
+// to date through notice(), so an idle source never scans the directory.
+//
+// read() returning 0 means nothing new yet rather than the end of the stream,
+// see AskBidMerger::set_live.
+class TailTickSource : public TickSource {
+public:
+	TailTickSource(const fs::path& dir, std::string symbol, Side side, std::uint32_t first_hour);
+
+	TailTickSource(const TailTickSource&) = delete;
+
+	TailTickSource&
+	operator=(const TailTickSource&) = delete;
+
+	~TailTickSource() override;
+
+	size_t
+	read(TickEntry* out, size_t capacity) override;
+
+	// yyyymmddhh of the file being followed, 0 until the first one appears
+	std::uint32_t
+	hour() const { return current; }
+
+	// a file created in or moved into dir; others are ignored
+	void
+	notice(const fs::path& file);
+
+	// rebuilds the list of later hours, e.g. after missed notifications
+	void
+	rescan();
+
+private:
+	static constexpr size_t READ_SIZE = 1 << 16;
+
+	fs::path dir;
+	std::string symbol;
+	Side side;
+
+	std::uint32_t first_hour;
+	std::uint32_t current = 0;
+
+	fs::path path;
+	int fd = -1;
+	ino_t inode = 0;
+	off_t offset = 0;
+
+	std::string pending;	// read but not yet parsed
+	size_t pos = 0;
+
+	std::map<std::uint32_t, std::string> later;		// hour -> file name
+
+	bool
+	refill();
+
+	bool
+	reopen_if_replaced();
+
+	// the smallest later hour present in dir, 0 if none
+	std::uint32_t
+	find_next(std::string& name);
+
+	void
+	open_hour(std::uint32_t hour, const std::string& name);
+};
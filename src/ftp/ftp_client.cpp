@@ -2,12 +2,16 @@
 #include <fstream>
 #include <filesystem>
 #include <sstream>
+#include <chrono>
+#include <thread>
+#include <utility>
 
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
 #include "./ftp_client.h"
+#include "../decompress/decompress.h"
 
 namespace {
 
@@ -18,12 +22,45 @@ write_to_string(void* ptr, size_t size, size_t nmemb, void* user_data) {
 	return size * nmemb;
 }
 
+// NOBODY requests still pass curl's synthesized headers to the write callback
+size_t
+discard_cb(char*, size_t size, size_t nmemb, void*) {
+	return size * nmemb;
+}
+
 size_t
 write_file_cb(char* ptr, size_t size, size_t nmemb, void* user_data) {
 	auto f = static_cast<std::FILE*>(user_data);
 	return std::fwrite(ptr, size, nmemb, f);
 }
 
+struct InflateSink {
+	GzipInflater* inflater;
+	std::FILE* keep;
+	std::exception_ptr error;
+	std::int64_t* received = nullptr;	// counts the bytes passed on if set
+};
+
+size_t
+write_inflate_cb(char* ptr, size_t size, size_t nmemb, void* user_data) {
+	auto sink = static_cast<InflateSink*>(user_data);
+	const auto bytes = size * nmemb;
+
+	// exceptions must not cross curl; returning short aborts the transfer
+	try {
+		if (sink->keep && std::fwrite(ptr, 1, bytes, sink->keep) != bytes) {
+			throw std::runtime_error("failed to write compressed copy");
+		}
+		sink->inflater->write(ptr, bytes);
+		if (sink->received) *sink->received += static_cast<std::int64_t>(bytes);
+	} catch (...) {
+		sink->error = std::current_exception();
+		return 0;
+	}
+
+	return bytes;
+}
+
 std::string
 join_url(const std::string& base, const std::string& rest) {
 	if (base.empty()) return rest;
@@ -55,6 +92,10 @@ FtpClient::connect(const FtpConfig& config) {
 		curl = curl_easy_init();
 		if (!curl) throw std::runtime_error("curl_easy_init failed");
 	}
+	if (!multi) {
+		multi = curl_multi_init();
+		if (!multi) throw std::runtime_error("curl_multi_init failed");
+	}
 
 	CURL* h = static_cast<CURL*>(curl);
 
@@ -62,6 +103,13 @@ FtpClient::connect(const FtpConfig& config) {
 	throw_curl(curl_easy_setopt(h, CURLOPT_PASSWORD, cfg.password.c_str()), "set password");
 
 	throw_curl(curl_easy_setopt(h, CURLOPT_VERBOSE, cfg.verbose ? 1L : 0L), "set verbose");
+
+	throw_curl(curl_easy_setopt(h, CURLOPT_CONNECTTIMEOUT_MS, cfg.connect_timeout_ms), "set connect timeout");
+	throw_curl(curl_easy_setopt(h, CURLOPT_TIMEOUT_MS, cfg.timeout_ms), "set timeout");
+	if (cfg.buffer_size) {
+		throw_curl(curl_easy_setopt(h, CURLOPT_BUFFERSIZE, cfg.buffer_size), "set buffer size");
+	}
+
 	connected = true;
 }
 
@@ -74,12 +122,113 @@ FtpClient::reset_state() const {
 	curl_easy_setopt(h, CURLOPT_URL, nullptr);
 	curl_easy_setopt(h, CURLOPT_WRITEDATA, nullptr);
 	curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, nullptr);
+	curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE, curl_off_t{0});
+}
+
+// libcurl (seen with 7.88) defers the passive data connection to its next
+// wakeup when the 229 reply is read in the same pass that sent EPSV, and
+// curl_easy_perform sleeps up to 1 s between wakeups. A fast server hits
+// that on nearly every file, so transfers run on our own multi handle with
+// a short poll instead.
+CURLcode
+FtpClient::perform() const {
+	constexpr int POLL_MS = 1;
+
+	auto* m = static_cast<CURLM*>(multi);
+	auto* h = static_cast<CURL*>(curl);
+
+	if (auto mc = curl_multi_add_handle(m, h); mc != CURLM_OK) {
+		throw std::runtime_error(std::string("curl_multi_add_handle: ") + curl_multi_strerror(mc));
+	}
+
+	CURLMcode mc = CURLM_OK;
+	int running = 1;
+	while (running && mc == CURLM_OK) {
+		mc = curl_multi_perform(m, &running);
+		if (running && mc == CURLM_OK) mc = curl_multi_poll(m, nullptr, 0, POLL_MS, nullptr);
+	}
+
+	CURLcode code = CURLE_OK;
+	int queued = 0;
+	while (auto* msg = curl_multi_info_read(m, &queued)) {
+		if (msg->msg == CURLMSG_DONE && msg->easy_handle == h) code = msg->data.result;
+	}
+
+	// the connection stays in the multi handle's cache for the next transfer
+	curl_multi_remove_handle(m, h);
+
+	if (mc != CURLM_OK) {
+		throw std::runtime_error(std::string("curl_multi_perform: ") + curl_multi_strerror(mc));
+	}
+	return code;
+}
+
+template <typename F>
+void
+FtpClient::with_retries(const std::string& what, F&& attempt) const {
+	for (std::uint32_t i = 0;; ++i) {
+		try {
+			attempt();
+			return;
+		} catch (const std::exception& e) {
+			if (i >= cfg.max_retries) throw;
+			++retries;
+
+			if (cfg.verbose) std::cerr << what << ": retrying after " << e.what() << "\n";
+			std::this_thread::sleep_for(std::chrono::milliseconds(cfg.retry_delay_ms * (i + 1)));
+		}
+	}
 }
 
 void
 FtpClient::download_to_file(	const std::string& symbol,
 								const std::string& name,
 								const std::filesystem::path& local_folder) const
+{
+	with_retries(name, [&] { download_to_file_once(symbol, name, local_folder); });
+}
+
+void
+FtpClient::download_inflated(	const std::string& symbol,
+								const std::string& name,
+								const std::filesystem::path& out_path,
+								const std::filesystem::path& keep_folder) const
+{
+	with_retries(name, [&] { download_inflated_once(symbol, name, out_path, keep_folder); });
+}
+
+std::int64_t
+FtpClient::download_appended(	const std::string& symbol,
+								const std::string& name,
+								std::int64_t offset,
+								GzipInflater& inflater) const
+{
+	std::int64_t received = 0;
+	with_retries(name, [&] { download_appended_once(symbol, name, offset + received, inflater, received); });
+
+	return received;
+}
+
+std::vector<std::string>
+FtpClient::list_files(const std::string& symbol) const {
+	std::vector<std::string> files {};
+	with_retries(symbol, [&] { files = list_files_once(symbol); });
+
+	return files;
+}
+
+std::int64_t
+FtpClient::remote_size(const std::string& symbol, const std::string& name) const {
+	std::int64_t size = -1;
+	with_retries(name, [&] { size = remote_size_once(symbol, name); });
+
+	return size;
+}
+
+void
+FtpClient::download_to_file_once(	const std::string& symbol,
+									const std::string& name,
+									const std::filesystem::path& local_folder) const
 {
 	if (!curl || !connected) {
 		throw std::runtime_error(name + " FtpClient::connect must be called before download_to_file");\
@@ -100,7 +249,7 @@ FtpClient::download_to_file(	const std::string& symbol,
 		throw_curl(curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, write_file_cb), name + " set writefunction");
 		throw_curl(curl_easy_setopt(h, CURLOPT_WRITEDATA, f), name + " set writedata");
 
-		code = curl_easy_perform(h);
+		code = perform();
 		throw_curl(code, name + " curl_easy_perform");
 
 		long inf = 0;
@@ -109,15 +258,106 @@ FtpClient::download_to_file(	const std::string& symbol,
 			throw std::runtime_error("FTP HTTP-like response code indicates failure: " + std::to_string(code) + " " + name);
 		}
 
-		std::fclose(f);
+		const bool failed = std::ferror(f) != 0;
+		if (std::fclose(std::exchange(f, nullptr)) != 0 || failed) {
+			throw std::runtime_error("failed to write output file: " + local_file_path.string());
+		}
+	} catch(...) {
+		if (f) std::fclose(f);
+		throw;
+	}
+}
+
+void
+FtpClient::download_inflated_once(	const std::string& symbol,
+									const std::string& name,
+									const std::filesystem::path& out_path,
+									const std::filesystem::path& keep_folder) const
+{
+	if (!curl || !connected) {
+		throw std::runtime_error(name + " FtpClient::connect must be called before download_inflated");
+	}
+
+	reset_state();
+
+	const auto url = join_url(join_url(cfg.url, symbol), name);
+
+	std::ofstream out(out_path, std::ios::binary);
+	if (!out) throw std::runtime_error("failed to open output file: " + out_path.string());
+
+	std::FILE* keep = nullptr;
+	if (!keep_folder.empty()) {
+		keep = std::fopen((keep_folder / name).string().c_str(), "wb");
+		if (!keep) throw std::runtime_error("failed to open output file: " + keep_folder.string());
+	}
+
+	GzipInflater inflater(out);
+	InflateSink sink { .inflater = &inflater, .keep = keep, .error = nullptr };
+
+	CURL* h = static_cast<CURL*>(curl);
+	try {
+		throw_curl(curl_easy_setopt(h, CURLOPT_URL, url.c_str()), name + " set url");
+		throw_curl(curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, write_inflate_cb), name + " set writefunction");
+		throw_curl(curl_easy_setopt(h, CURLOPT_WRITEDATA, &sink), name + " set writedata");
+
+		auto code = perform();
+		if (sink.error) std::rethrow_exception(sink.error);
+		throw_curl(code, name + " curl_easy_perform");
+
+		if (!inflater.finished()) {
+			throw std::runtime_error("gunzip stream ended prematurely: " + name);
+		}
+
+		out.close();
+		if (!out) throw std::runtime_error("failed to write output file: " + out_path.string());
+
+		if (keep) {
+			const bool failed = std::ferror(keep) != 0;
+			if (std::fclose(std::exchange(keep, nullptr)) != 0 || failed) {
+				throw std::runtime_error("failed to write compressed copy: " + (keep_folder / name).string());
+			}
+		}
 	} catch(...) {
-		std::fclose(f);
+		if (keep) std::fclose(keep);
+		out.close();
+
+		std::filesystem::remove(out_path);
+		if (!keep_folder.empty()) std::filesystem::remove(keep_folder / name);
 		throw;
 	}
 }
 
+void
+FtpClient::download_appended_once(	const std::string& symbol,
+									const std::string& name,
+									std::int64_t offset,
+									GzipInflater& inflater,
+									std::int64_t& received) const
+{
+	if (!curl || !connected) {
+		throw std::runtime_error(name + " FtpClient::connect must be called before download_appended");
+	}
+
+	reset_state();
+
+	const auto url = join_url(join_url(cfg.url, symbol), name);
+	InflateSink sink { .inflater = &inflater, .keep = nullptr, .error = nullptr, .received = &received };
+
+	CURL* h = static_cast<CURL*>(curl);
+	throw_curl(curl_easy_setopt(h, CURLOPT_URL, url.c_str()), name + " set url");
+	throw_curl(curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(offset)), name + " set resume");
+	throw_curl(curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, write_inflate_cb), name + " set writefunction");
+	throw_curl(curl_easy_setopt(h, CURLOPT_WRITEDATA, &sink), name + " set writedata");
+
+	auto code = perform();
+	curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE, curl_off_t{0});
+
+	if (sink.error) std::rethrow_exception(sink.error);
+	throw_curl(code, name + " curl_easy_perform");
+}
+
 std::vector<std::string>
-FtpClient::list_files(const std::string& symbol) const {
+FtpClient::list_files_once(const std::string& symbol) const {
 	if (!curl || !connected) {
 		throw std::runtime_error("FtpClient::connect must be called before download_to_file");\
 	}
@@ -136,7 +376,7 @@ FtpClient::list_files(const std::string& symbol) const {
     throw_curl(curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, write_to_string), "set writefunction");
 	throw_curl(curl_easy_setopt(h, CURLOPT_WRITEDATA, &listing), "set writedata");
 
-	auto code = curl_easy_perform(h);
+	auto code = perform();
 	curl_easy_setopt(h, CURLOPT_DIRLISTONLY, 0L);
 
 	throw_curl(code, "curl_easy_perform");
@@ -151,3 +391,29 @@ FtpClient::list_files(const std::string& symbol) const {
 
 	return files;
 }
+
+std::int64_t
+FtpClient::remote_size_once(const std::string& symbol, const std::string& name) const {
+	if (!curl || !connected) {
+		throw std::runtime_error(name + " FtpClient::connect must be called before remote_size");
+	}
+
+	reset_state();
+	CURL* h = static_cast<CURL*>(curl);
+
+	const auto url = join_url(join_url(cfg.url, symbol), name);
+
+	throw_curl(curl_easy_setopt(h, CURLOPT_URL, url.c_str()), name + " set url");
+	throw_curl(curl_easy_setopt(h, CURLOPT_NOBODY, 1L), name + " set nobody");
+	throw_curl(curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, discard_cb), name + " set writefunction");
+
+	auto code = perform();
+	curl_easy_setopt(h, CURLOPT_NOBODY, 0L);
+
+	throw_curl(code, name + " curl_easy_perform");
+
+	curl_off_t size = -1;
+	curl_easy_getinfo(h, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+
+	return size;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
 #include <string>
 #include <vector>
 
@@ -7,11 +9,20 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
+class GzipInflater;
+
 struct FtpConfig {
 	std::string url;
 	std::string username;
 	std::string password;
 	bool verbose = false;
+
+	long connect_timeout_ms = 0;	// 0 keeps curl's default
+	long timeout_ms = 0;			// whole transfer, 0 = no limit
+	long buffer_size = 0;			// receive buffer, 0 keeps curl's default
+
+	std::uint32_t max_retries = 0;
+	std::uint32_t retry_delay_ms = 500;	// grows linearly per attempt
 };
 
 class FtpClient {
@@ -25,9 +36,8 @@ public:
 	}
 
 	~FtpClient() {
-		if (!curl) return;
-		curl_easy_cleanup(static_cast<CURL*>(curl));
-		curl = nullptr;
+		if (multi) curl_multi_cleanup(static_cast<CURLM*>(multi));
+		if (curl) curl_easy_cleanup(static_cast<CURL*>(curl));
 	}
 
 	FtpClient&
@@ -36,13 +46,17 @@ public:
 	FtpClient&
 	operator=(FtpClient&& other) noexcept {
 		if (this == &other) return *this;
+		if (multi) curl_multi_cleanup(static_cast<CURLM*>(multi));
 		if (curl) curl_easy_cleanup(static_cast<CURL*>(curl));
 
 		curl      = other.curl;
+		multi     = other.multi;
 		cfg       = std::move(other.cfg);
 		connected = other.connected;
+		retries   = other.retries;
 
 		other.curl = nullptr;
+		other.multi = nullptr;
 		other.connected = false;
 
 		return *this;
@@ -56,14 +70,73 @@ public:
 						const std::string& name,
 						const std::filesystem::path& local_path) const;
 
+	// Inflates the .gz while it downloads, writing the decompressed data to
+	// out_path. A non-empty keep_folder also receives the compressed original.
+	void
+	download_inflated(	const std::string& symbol,
+						const std::string& name,
+						const std::filesystem::path& out_path,
+						const std::filesystem::path& keep_folder = {}) const;
+
+	// Feeds the bytes of name from offset on (REST) into inflater, e.g. what
+	// was appended to a growing file since the last download. A retry resumes
+	// where the failed attempt stopped. Returns the bytes received.
+	std::int64_t
+	download_appended(	const std::string& symbol,
+						const std::string& name,
+						std::int64_t offset,
+						GzipInflater& inflater) const;
+
 	std::vector<std::string>
 	list_files(const std::string& symbol) const;
 
+	// size reported by the server (SIZE), -1 when it does not tell
+	std::int64_t
+	remote_size(const std::string& symbol, const std::string& name) const;
+
+	// failed attempts that were retried since construction
+	std::size_t
+	retry_count() const { return retries; }
+
 private:
 	FtpConfig cfg{};
 	void* curl = nullptr;
+	void* multi = nullptr;		// drives curl, holding the reused connection
 	bool connected = false;
+	mutable std::size_t retries = 0;
+
+	template <typename F>
+	void
+	with_retries(const std::string& what, F&& attempt) const;
+
+	void
+	download_to_file_once(	const std::string& symbol,
+							const std::string& name,
+							const std::filesystem::path& local_path) const;
+
+	void
+	download_inflated_once(	const std::string& symbol,
+							const std::string& name,
+							const std::filesystem::path& out_path,
+							const std::filesystem::path& keep_folder) const;
+
+	void
+	download_appended_once(	const std::string& symbol,
+							const std::string& name,
+							std::int64_t offset,
+							GzipInflater& inflater,
+							std::int64_t& received) const;
+
+	std::vector<std::string>
+	list_files_once(const std::string& symbol) const;
+
+	std::int64_t
+	remote_size_once(const std::string& symbol, const std::string& name) const;
 
 	void
 	reset_state() const;
+
+	// curl_easy_perform through multi, see ftp_client.cpp
+	CURLcode
+	perform() const;
 };
@@ -0,0 +1,157 @@
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+namespace {
+
+const char*
+stage_name(Stage stage) {
+	switch (stage) {
+		case Stage::Download: return "download";
+		case Stage::Inflate:  return "inflate";
+		case Stage::Write:    return "write";
+	}
+	return "unknown";
+}
+
+std::string
+entry_key(Stage stage, const std::string& unit) {
+	return std::string(stage_name(stage)) + '\t' + unit;
+}
+
+std::string
+format_record(const std::string& key, std::uint64_t size) {
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(size));
+	return key + '\t' + hex + '\n';
+}
+
+void
+throw_errno(const std::string& what) {
+	throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+}
+
+Journal::Journal(const fs::path& path) {
+	if (path.has_parent_path()) fs::create_directories(path.parent_path());
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) throw_errno("failed to open journal " + path.string());
+
+	const auto valid = load(path, entries);
+
+	// drop a torn final record so the next append starts on a fresh line
+	if (valid != fs::file_size(path) && ::ftruncate(fd, static_cast<off_t>(valid)) != 0) {
+		::close(fd);
+		throw_errno("failed to truncate journal " + path.string());
+	}
+}
+
+Journal::~Journal() {
+	if (fd >= 0) ::close(fd);
+}
+
+std::size_t
+Journal::load(const fs::path& path, std::unordered_map<std::string, std::uint64_t>& into) {
+	std::ifstream in(path, std::ios::binary);
+	std::string content{std::istreambuf_iterator<char>(in), {}};
+
+	std::size_t pos = 0;
+	while (true) {
+		auto end = content.find('\n', pos);
+		if (end == std::string::npos) break;
+
+		std::string_view line(content.data() + pos, end - pos);
+		pos = end + 1;
+
+		auto tab = line.rfind('\t');
+		if (tab == std::string_view::npos || tab == 0) continue;
+
+		std::uint64_t size = 0;
+		auto hex = line.substr(tab + 1);
+		auto [ptr, ec] = std::from_chars(hex.data(), hex.data() + hex.size(), size, 16);
+		if (ec != std::errc{} || ptr != hex.data() + hex.size()) continue;
+
+		into[std::string(line.substr(0, tab))] = size;
+	}
+
+	return pos;
+}
+
+void
+Journal::include(const fs::path& path) {
+	std::lock_guard lock(mutex);
+	load(path, entries);
+}
+
+std::size_t
+Journal::merge_from(const fs::path& path) {
+	std::unordered_map<std::string, std::uint64_t> other{};
+	load(path, other);
+
+	std::lock_guard lock(mutex);
+
+	std::string lines{};
+	std::vector<std::pair<std::string, std::uint64_t>> added{};
+	for (auto& [key, size] : other) {
+		auto iter = entries.find(key);
+		if (iter != entries.end() && iter->second == size) continue;
+
+		lines += format_record(key, size);
+		added.emplace_back(key, size);
+	}
+	if (added.empty()) return 0;
+
+	// one write and one sync for the whole batch
+	if (::write(fd, lines.data(), lines.size()) != static_cast<ssize_t>(lines.size())) {
+		throw_errno("failed to append journal records from " + path.string());
+	}
+	if (::fdatasync(fd) != 0) throw_errno("failed to sync journal");
+
+	for (auto& [key, size] : added) entries[std::move(key)] = size;
+	return added.size();
+}
+
+bool
+Journal::done(Stage stage, const std::string& unit) const {
+	std::lock_guard lock(mutex);
+	return entries.contains(entry_key(stage, unit));
+}
+
+std::optional<std::uint64_t>
+Journal::size(Stage stage, const std::string& unit) const {
+	std::lock_guard lock(mutex);
+
+	auto iter = entries.find(entry_key(stage, unit));
+	if (iter == entries.end()) return std::nullopt;
+
+	return iter->second;
+}
+
+void
+Journal::record(Stage stage, const std::string& unit, std::uint64_t size) {
+	auto key = entry_key(stage, unit);
+	const auto line = format_record(key, size);
+
+	std::lock_guard lock(mutex);
+
+	// O_APPEND makes the single write atomic with respect to other records
+	if (::write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+		throw_errno("failed to append journal record " + key);
+	}
+	if (::fdatasync(fd) != 0) throw_errno("failed to sync journal");
+
+	entries[std::move(key)] = size;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+enum class Stage : std::uint8_t {
+	Download,
+	Inflate,
+	Write,
+};
+
+// Append-only record of finished work units. Every record is synced to disk
+// before record() returns, so after a crash the journal lists exactly the
+// units that completed; anything else is reprocessed. Opening a journal
+// repairs a torn tail, so only one process may have it open: shard workers
+// keep their own and the coordinator merges them, see shard.h.
+class Journal {
+public:
+	explicit
+	Journal(const fs::path& path);
+
+	Journal(const Journal&) = delete;
+
+	Journal&
+	operator=(const Journal&) = delete;
+
+	~Journal();
+
+	bool
+	done(Stage stage, const std::string& unit) const;
+
+	// size recorded with the unit: bytes of a downloaded or inflated file,
+	// which the pipeline compares before skipping it, or candles of a day
+	std::optional<std::uint64_t>
+	size(Stage stage, const std::string& unit) const;
+
+	void
+	record(Stage stage, const std::string& unit, std::uint64_t size = 0);
+
+	// Reads the entries of another journal, e.g. the main one in a shard
+	// worker, as done. Neither file is written.
+	void
+	include(const fs::path& path);
+
+	// Records every entry of the journal at path that this one lacks or has
+	// with another value, synced once. Returns the number recorded.
+	std::size_t
+	merge_from(const fs::path& path);
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, std::uint64_t> entries;
+	int fd = -1;
+
+	// returns the length of the intact prefix
+	static std::size_t
+	load(const fs::path& path, std::unordered_map<std::string, std::uint64_t>& into);
+};
@@ -1,141 +1,250 @@
 #include <iostream>
-#include <fstream>
 #include <filesystem>
-#include <functional>
+#include <charconv>
+#include <cstdlib>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
-#include "./writer/writer.h"
-#include "./transform/transform.h"
-#include "./organizer/organizer.h"
-#include "./ftp/ftp_client.h"
+#include "./pipeline/pipeline.h"
+#include "./shard/shard.h"
+#include "./verify/verify.h"
+#include "./columnar/columnar.h"
+#include "./follow/follow.h"
+#include "./journal/journal.h"
 #include "./dotenv/dotenv.h"
-#include "./decompress/decompress.h"
+#include "./memory/buffer_pool.h"
+#include "./writer/writer.h"
 
 namespace fs = std::filesystem;
 
-using LogAction = std::function<void(spdlog::logger&)>;
-
 struct CurlGlobal {
     CurlGlobal()  { curl_global_init(CURL_GLOBAL_DEFAULT); }
     ~CurlGlobal() { curl_global_cleanup(); }
 };
 
-bool
-with_logger(const fs::path& root,
-			const std::string& category,
-			const std::string& symbol,
-			const LogAction& action)
-{
-	const auto dir = root / category;
-	fs::create_directories(dir);
-
-	const auto file = dir / symbol;
-	const auto name = category + "_" + symbol;
-
-	auto logger = spdlog::get(name);
-	if (!logger) {
-		logger = spdlog::basic_logger_mt(
-			name, file.string(), false
-		);
+namespace {
+
+void
+usage() {
+	std::cerr <<
+		"usage: candles [--from=<day>[_<hour>]] [--to=<day>[_<hour>]] [mode]\n"
+		"  run                     download, inflate and write every day (default)\n"
+		"  coordinate <shards>     download and inflate, then write through <shards>\n"
+		"                          worker processes and merge their databases\n"
+		"  worker <index> <count>  write one shard into its own database and journal\n"
+		"  merge <count>           fold shard databases and journals into DB_PATH\n"
+		"                          and JOURNAL_PATH\n"
+		"  follow                  tail the newest hours and upsert candles as\n"
+		"                          ticks arrive, until SIGINT/SIGTERM\n"
+		"  compact                 dedupe append-mode partitions written since\n"
+		"                          their last compaction (STORAGE_MODE=append)\n"
+		"  verify [parquet]        check the stored candles (or Parquet files) for\n"
+		"                          broken invariants and re-aggregate sampled days\n"
+		"  export [dir]            write the stored candles into a memory-mappable\n"
+		"                          candle file under dir (or COLUMNAR_FOLDER)\n"
+		"--from/--to (or RANGE_FROM/RANGE_TO) limit every stage to those hours,\n"
+		"e.g. --from=2024-03-04 --to=2024-03-10_17, and redo them even when the\n"
+		"journal has them as done, so a bad week can be repaired in place\n";
+}
+
+// Moves --from=/--to= out of argv into range_args and returns the new argc.
+int
+take_range_options(int argc, char** argv, std::vector<std::string>& range_args) {
+	int kept = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+
+		if (arg.starts_with("--from=") || arg.starts_with("--to=")) {
+			range_args.emplace_back(arg);
+			continue;
+		}
+		argv[kept++] = argv[i];
+	}
+
+	return kept;
+}
+
+// after .env, so the command line wins over it
+void
+apply_range_options(const std::vector<std::string>& range_args) {
+	for (const auto& arg : range_args) {
+		const auto eq = arg.find('=');
+		const auto name = arg.starts_with("--from=") ? "RANGE_FROM" : "RANGE_TO";
+		setenv(name, arg.c_str() + eq + 1, 1);
 	}
+}
 
-	try {
-		action(*logger);
-	} catch (const std::exception& e) {
-		logger->error(e.what());
-		logger->flush();
+// decimal number filling the whole argument
+std::optional<std::size_t>
+parse_number(std::string_view arg) {
+	std::size_t n = 0;
+	const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), n);
+	if (arg.empty() || ec != std::errc{} || ptr != arg.data() + arg.size()) return std::nullopt;
+	return n;
+}
 
-		return false;
-    }
+// shard count, at least one
+std::optional<std::size_t>
+parse_count(std::string_view arg) {
+	const auto n = parse_number(arg);
+	if (!n || *n == 0) return std::nullopt;
+	return n;
+}
 
-	return true;
 }
 
-int main() {
+int main(int argc, char** argv) {
+	std::vector<std::string> range_args{};
+	argc = take_range_options(argc, argv, range_args);
+
     load_dotenv(".env");
+	apply_range_options(range_args);
 
-	const fs::path log_path = std::getenv("LOGS_FOLDER_PATH");
-	fs::create_directory(log_path);
+	const std::string mode = argc > 1 ? argv[1] : "run";
+	const std::string symbol = "ADAUSD";
 
-	const FtpConfig cfg {
-		.url = std::getenv("FTP_URL"),
-		.username = std::getenv("FTP_USERNAME"),
-		.password = std::getenv("FTP_PASSWORD"),
-		.verbose = true,
-	};
+	const auto settings = load_settings(symbol);
+	fs::create_directory(settings.log_path);
+
+	BufferPool::instance().use_huge_pages(settings.huge_pages);
 
 	CurlGlobal curl_guard;
-	const std::string symbol = "ADAUSD";
+	const auto& log_path = settings.log_path;
+
+	// before the main journal is opened: workers run beside the coordinator,
+	// which has it open, and only read it
+	if (mode == "worker" && argc == 4) {
+		const auto index = parse_number(argv[2]);
+		const auto count = parse_count(argv[3]);
+		if (!index || !count || *index >= *count) {
+			usage();
+			return 2;
+		}
+		const Shard shard { .index = *index, .count = *count };
 
-	const fs::path download_folder = std::getenv("FTP_DOWNLOAD_FOLDER");
-	const auto download_symbol_dir = download_folder / symbol;
+		Journal journal{shard_journal_path(settings.journal_path, shard)};
+		journal.include(settings.journal_path);
 
-	with_logger(log_path, "ftp", symbol, [&](spdlog::logger& logger) {
+		const auto category = "write-shard-" + std::to_string(shard.index);
+		const bool ok = with_logger(log_path, category, symbol, [&](spdlog::logger& logger) {
+			write_stage(settings, journal, logger, shard_db_path(settings.db_path, shard), shard);
+		});
+		return ok ? 0 : 1;
+	}
 
-		FtpClient client;
-		client.connect(cfg);
+	Journal journal{settings.journal_path};
+
+	auto fetch = [&]() {
+		// both run: a failed download still leaves earlier files to inflate
+		const bool downloaded = with_logger(log_path, "ftp", symbol, [&](spdlog::logger& logger) {
+			download_stage(settings, journal, logger);
+		});
+		const bool inflated = with_logger(log_path, "decompress", symbol, [&](spdlog::logger& logger) {
+			decompress_stage(settings, journal, logger);
+		});
+		return downloaded && inflated;
+	};
 
-		auto remote_files = client.list_files(symbol);
-		logger.info(
-			"Downloading batch: symbol={}, count={}",
-			symbol,
-			remote_files.size()
-		);
+	if (mode == "run") {
+		// the write stage still saves what did arrive
+		const bool fetched = fetch();
 
-		fs::create_directories(download_symbol_dir);
+		const bool ok = with_logger(log_path, "write", symbol, [&](spdlog::logger& logger) {
+			const auto written = write_stage(settings, journal, logger, settings.db_path);
+			if (!settings.columnar_dir.empty()) export_written_candles(settings, settings.columnar_dir, written, logger);
+		});
+		return ok && fetched ? 0 : 1;
+	}
 
-		for (const auto& filename : remote_files) {
-			logger.info("Downloading {}", filename);
-			client.download_to_file(symbol, filename, download_symbol_dir);
+	if (mode == "merge" && argc == 3) {
+		const auto count = parse_count(argv[2]);
+		if (!count) {
+			usage();
+			return 2;
 		}
-	});
-
-	const fs::path unzipped_dir = std::getenv("DECOMPRESSED_FOLDER"); 
-	fs::create_directories(unzipped_dir);
 
-	with_logger(log_path, "decompress", symbol, [&](spdlog::logger& logger) {
-		for (const auto& entry : fs::directory_iterator(download_symbol_dir)) {
-			auto gz_path = entry.path();
+		const bool ok = with_logger(log_path, "merge", symbol, [&](spdlog::logger& logger) {
+			merge_shards(settings, *count, journal, logger);
+		});
+		return ok ? 0 : 1;
+	}
 
-			std::ifstream in(gz_path, std::ios::binary);
-			if (!in) throw std::runtime_error("failed to open input: " + gz_path.string());
+	if (mode == "coordinate" && argc == 3) {
+		const auto count = parse_count(argv[2]);
+		if (!count) {
+			usage();
+			return 2;
+		}
 
-			auto out_path = unzipped_dir / gz_path.stem().string();
+		if (!fetch()) return 1;
 
-			std::ofstream out(out_path, std::ios::binary);
-			if (!out) throw std::runtime_error("failed to open output: " + out_path.string());
+		const bool ok = with_logger(log_path, "coordinate", symbol, [&](spdlog::logger& logger) {
+			const auto retries = static_cast<std::uint32_t>(env_number("SHARD_RETRIES", 2));
+			const auto failed = run_shard_workers(
+				fs::read_symlink("/proc/self/exe"), *count, retries, range_args, logger
+			);
 
-			decompress_gzip(in, out, logger);
-		}
-	});
+			// failed shards still hold their journaled days, so every shard
+			// is merged; rerunning only redoes the days that were not written
+			merge_shards(settings, *count, journal, logger);
 
-	fs::path db_path = std::getenv("DB_PATH");
-	BatchOrganizer organizer{unzipped_dir};
+			if (!failed.empty()) {
+				throw std::runtime_error(std::to_string(failed.size()) + " shard(s) failed");
+			}
+		});
+		return ok ? 0 : 1;
+	}
 
-	with_logger(log_path, "write", symbol, [&](spdlog::logger& logger) {
-		for (const auto& entry : fs::directory_iterator(unzipped_dir)) {
+	if (mode == "follow" && argc == 2) {
+		const bool ok = with_logger(log_path, "follow", symbol, [&](spdlog::logger& logger) {
+			follow_stage(settings, logger);
+		});
+		return ok ? 0 : 1;
+	}
 
-			const auto name = entry.path().filename().string();
-			auto [a, b] = organizer.get_batch(name);
-			if (a.size() ==0 && b.size() == 0) continue;
+	if (mode == "compact" && argc == 2) {
+		const bool ok = with_logger(log_path, "compact", symbol, [&](spdlog::logger& logger) {
+			const auto months = compact_candles(settings.db_path, symbol);
 
-			MultiFileReader ask(a, unzipped_dir);
-			MultiFileReader bid(b, unzipped_dir);
+			for (const auto& month : months) logger.info("Compacted candles_{}_{}", symbol, month);
+			logger.info("Compacted {} partition(s)", months.size());
+		});
+		return ok ? 0 : 1;
+	}
 
-			const std::int64_t f = 15 * 1000;
-			AskBidMerger reader { std::move(ask), std::move(bid), f };
+	if (mode == "verify" && argc <= 3) {
+		const std::string parquet = argc == 3 ? argv[2] : "";
 
-			Candle c;
-			std::vector<Candle> candles{};
+		const bool ok = with_logger(log_path, "verify", symbol, [&](spdlog::logger& logger) {
+			const auto sample_days = static_cast<std::size_t>(env_number("VERIFY_SAMPLE_DAYS", 3));
+			const auto report = verify_candles(settings, parquet, sample_days, logger);
 
-			while(reader.get_next_candle(c)) candles.push_back(c);
-			write_candles_to_db(candles, db_path, symbol);
+			if (!report.ok()) throw std::runtime_error("candle verification failed");
+		});
+		return ok ? 0 : 1;
+	}
 
-			organizer.delete_key(name);
+	if (mode == "export" && argc <= 3) {
+		const fs::path dir = argc == 3 ? fs::path{argv[2]} : settings.columnar_dir;
+		if (dir.empty()) {
+			usage();
+			return 2;
 		}
-	});
-}
\ No newline at end of file
+
+		const bool ok = with_logger(log_path, "export", symbol, [&](spdlog::logger& logger) {
+			export_candle_file(settings, dir, logger);
+		});
+		return ok ? 0 : 1;
+	}
+
+	usage();
+	return 2;
+}
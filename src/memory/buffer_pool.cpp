@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include <sys/mman.h>
+
+#include "buffer_pool.h"
+
+BufferPool&
+BufferPool::instance() {
+	static BufferPool pool;
+	return pool;
+}
+
+BufferPool::~BufferPool() {
+	for (auto* slab : slabs) std::free(slab);
+}
+
+void
+BufferPool::use_huge_pages(bool enable) {
+	std::lock_guard lock(mutex);
+	huge_pages = enable;
+}
+
+BufferPool::Buffer
+BufferPool::acquire() {
+	std::lock_guard lock(mutex);
+	++counters.acquires;
+
+	if (free_list.empty()) {
+		auto* slab = static_cast<unsigned char*>(std::aligned_alloc(SLAB_SIZE, SLAB_SIZE));
+		if (!slab) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+		if (huge_pages) ::madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+
+		slabs.push_back(slab);
+		++counters.slabs;
+
+		for (size_t off = SLAB_SIZE; off > 0; off -= BUFFER_SIZE) {
+			free_list.push_back(slab + off - BUFFER_SIZE);
+		}
+	} else {
+		++counters.hits;
+	}
+
+	auto* ptr = free_list.back();
+	free_list.pop_back();
+
+	counters.peak_in_use = std::max(counters.peak_in_use, ++counters.in_use);
+	return Buffer{ptr};
+}
+
+void
+BufferPool::release(unsigned char* ptr) {
+	std::lock_guard lock(mutex);
+
+	free_list.push_back(ptr);
+	--counters.in_use;
+}
+
+BufferPool::Stats
+BufferPool::stats() const {
+	std::lock_guard lock(mutex);
+	return counters;
+}
+
+BatchArena::~BatchArena() {
+	for (auto& block : blocks) {
+		if (!block.pooled.data()) ::operator delete(block.data, std::align_val_t{64});
+	}
+}
+
+void
+BatchArena::reset() {
+	current = 0;
+	offset = 0;
+	used = 0;
+}
+
+void*
+BatchArena::do_allocate(size_t bytes, size_t alignment) {
+	auto fits = [&](const Block& block, size_t from) {
+		auto aligned = (from + alignment - 1) & ~(alignment - 1);
+		return aligned + bytes <= block.size ? aligned : SIZE_MAX;
+	};
+
+	// bump in the current block, then try the retained ones after it
+	for (; current < blocks.size(); ++current, offset = 0) {
+		auto at = fits(blocks[current], offset);
+		if (at == SIZE_MAX) continue;
+
+		offset = at + bytes;
+		used += bytes;
+		peak = std::max(peak, used);
+
+		return blocks[current].data + at;
+	}
+
+	Block block{};
+	if (bytes + alignment <= BufferPool::BUFFER_SIZE) {
+		block.pooled = BufferPool::instance().acquire();
+		block.data = block.pooled.data();
+		block.size = BufferPool::BUFFER_SIZE;
+	} else {
+		block.size = bytes + alignment;
+		block.data = static_cast<unsigned char*>(::operator new(block.size, std::align_val_t{64}));
+	}
+
+	blocks.push_back(std::move(block));
+	current = blocks.size() - 1;
+	offset = 0;
+
+	return do_allocate(bytes, alignment);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+// Process-wide pool of fixed-size, page-aligned buffers shared by the
+// download, decompress, reader and transform stages. Buffers are carved
+// from 2 MB slabs, which can be backed by transparent huge pages, and are
+// never returned to the system.
+class BufferPool {
+public:
+	static constexpr size_t BUFFER_SIZE = 1 << 20;
+	static constexpr size_t SLAB_SIZE = 2 << 20;
+
+	class Buffer {
+	public:
+		Buffer() = default;
+
+		Buffer(const Buffer&) = delete;
+
+		Buffer&
+		operator=(const Buffer&) = delete;
+
+		Buffer(Buffer&& other) noexcept: ptr(other.ptr) { other.ptr = nullptr; }
+
+		Buffer&
+		operator=(Buffer&& other) noexcept {
+			if (this == &other) return *this;
+			reset();
+
+			ptr = other.ptr;
+			other.ptr = nullptr;
+			return *this;
+		}
+
+		~Buffer() { reset(); }
+
+		unsigned char*
+		data() const { return ptr; }
+
+		static constexpr size_t
+		size() { return BUFFER_SIZE; }
+
+		void
+		reset() {
+			if (ptr) BufferPool::instance().release(ptr);
+			ptr = nullptr;
+		}
+
+	private:
+		friend class BufferPool;
+		explicit Buffer(unsigned char* ptr): ptr(ptr) {}
+
+		unsigned char* ptr = nullptr;
+	};
+
+	struct Stats {
+		std::uint64_t acquires = 0;
+		std::uint64_t hits = 0;			// served from the free list
+		std::uint64_t slabs = 0;		// slabs allocated from the system
+		std::uint64_t in_use = 0;
+		std::uint64_t peak_in_use = 0;
+
+		double
+		hit_rate() const { return acquires ? static_cast<double>(hits) / static_cast<double>(acquires) : 1.0; }
+	};
+
+	static BufferPool&
+	instance();
+
+	BufferPool(const BufferPool&) = delete;
+
+	BufferPool&
+	operator=(const BufferPool&) = delete;
+
+	~BufferPool();
+
+	// applies to slabs allocated from now on
+	void
+	use_huge_pages(bool enable);
+
+	Buffer
+	acquire();
+
+	Stats
+	stats() const;
+
+private:
+	BufferPool() = default;
+
+	mutable std::mutex mutex;
+	std::vector<unsigned char*> free_list;
+	std::vector<unsigned char*> slabs;
+
+	bool huge_pages = false;
+	Stats counters{};
+
+	void
+	release(unsigned char* ptr);
+};
+
+// Bump allocator for one batch (e.g. a day) on top of pool buffers.
+// reset() rewinds without giving memory back, so once the first batch has
+// sized the arena the following ones allocate nothing. Requests larger than
+// a pool buffer get dedicated blocks that are kept and reused the same way.
+class BatchArena : public std::pmr::memory_resource {
+public:
+	BatchArena() = default;
+
+	BatchArena(const BatchArena&) = delete;
+
+	BatchArena&
+	operator=(const BatchArena&) = delete;
+
+	~BatchArena() override;
+
+	void
+	reset();
+
+	size_t
+	peak_bytes() const { return peak; }
+
+private:
+	struct Block {
+		unsigned char* data;
+		size_t size;
+		BufferPool::Buffer pooled;	// empty for oversized blocks
+	};
+
+	std::vector<Block> blocks;
+	size_t current = 0;		// index into blocks
+	size_t offset = 0;		// within blocks[current]
+	size_t used = 0;
+	size_t peak = 0;
+
+	void*
+	do_allocate(size_t bytes, size_t alignment) override;
+
+	void
+	do_deallocate(void*, size_t, size_t) override {}
+
+	bool
+	do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+};
@@ -1,113 +1,147 @@
-#include <algorithm>
-#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
 
 #include "organizer.h"
 
-bool
-BatchOrganizer::is_ask(const std::string& filename) const {
-	auto pos = filename.find("_ASK_");
-	return pos != std::string::npos;
-}
+struct MultiFileReader::Gzip {
+	z_stream stream{};
+	BufferPool::Buffer in = BufferPool::instance().acquire();
+	bool done = false;
 
-bool
-BatchOrganizer::is_bid(const std::string& filename) const {
-	auto pos = filename.find("_BID_");
-	return pos != std::string::npos;
-}
+	Gzip() {
+		if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) throw std::runtime_error("inflateInit2 failed");
+	}
 
-std::string
-BatchOrganizer::get_key(const std::string& filename) const {
-	auto first  = filename.find('_');
-	auto second = filename.find('_', first + 1);
-	auto third  = filename.find('_', second + 1);
+	Gzip(const Gzip&) = delete;
 
-	return filename.substr(second + 1, third - (second + 1));
-}
+	Gzip&
+	operator=(const Gzip&) = delete;
 
-int
-BatchOrganizer::extract_hour(const std::string& filename) const {
-	auto pos = filename.rfind('_');
-	// if (pos == std::string::npos) return -1;
-	std::string hour_part = filename.substr(pos + 1);
+	~Gzip() { inflateEnd(&stream); }
+};
 
-	auto dot = hour_part.find('.');
-	hour_part = hour_part.substr(0, dot);
+MultiFileReader::MultiFileReader(const std::vector<std::string>& files, const fs::path& dir):
+	files(files), curr_idx(0), dir{dir} {}
 
-	return std::stoi(hour_part);
+MultiFileReader::MultiFileReader(MultiFileReader&& other) noexcept:
+	files(std::move(other.files)),
+	curr_idx(other.curr_idx),
+	dir(std::move(other.dir)),
+	fd(other.fd),
+	gzip(std::move(other.gzip)),
+	buf(std::move(other.buf)),
+	begin(other.begin),
+	end(other.end)
+{
+	other.fd = -1;
 }
 
-void
-BatchOrganizer::sort_by_hour(std::vector<std::string>& filenames) const {
-	auto fn = [&](const std::string& a, const std::string& b) {
-		return extract_hour(a) < extract_hour(b);
-	};
-	std::sort(filenames.begin(), filenames.end(), fn);
+MultiFileReader::~MultiFileReader() {
+	if (fd >= 0) ::close(fd);
 }
 
-void
-BatchOrganizer::populate_dict(const fs::path& directory) {
-	for (const auto& entry : fs::directory_iterator(directory)) {
-		auto filename = entry.path().filename().string();
-		auto key = get_key(filename);
+size_t
+MultiFileReader::read_some(char* out, size_t size) {
+	while (true) {
+		if (gzip && gzip->done) return 0;
 
-		dict[key].push_back(filename);
-	}
+		if (!gzip || gzip->stream.avail_in == 0) {
+			auto* into = gzip ? reinterpret_cast<char*>(gzip->in.data()) : out;
+			auto got = ::read(fd, into, gzip ? gzip->in.size() : size);
 
-	for (auto& [key, value] : dict) {
-		sort_by_hour(value);
-	}
-}
+			if (got < 0) {
+				if (errno == EINTR) continue;
+				throw std::runtime_error("Failed to read " + files[curr_idx] + ": " + std::strerror(errno));
+			}
+			if (!gzip) return static_cast<size_t>(got);
+			if (got == 0) throw std::runtime_error("Truncated gzip file " + files[curr_idx]);
 
-std::pair<std::vector<std::string>, std::vector<std::string>>
-BatchOrganizer::get_batch(const std::string& filename) const {
-	auto key = get_key(filename);
-	auto iter = dict.find(key);
+			gzip->stream.next_in = gzip->in.data();
+			gzip->stream.avail_in = static_cast<uInt>(got);
+		}
 
-	if (iter == dict.end()) return {};
+		auto& stream = gzip->stream;
+		stream.next_out = reinterpret_cast<Bytef*>(out);
+		stream.avail_out = static_cast<uInt>(size);
 
-	std::vector<std::string> ask {};
-	std::vector<std::string> bid {};
+		const int ret = inflate(&stream, Z_NO_FLUSH);
+		if (ret < 0 || ret == Z_NEED_DICT) {
+			throw std::runtime_error(
+				"gunzip of " + files[curr_idx] + " failed: " + (stream.msg ? stream.msg : std::to_string(ret))
+			);
+		}
 
-	ask.reserve(iter->second.size() / 2 + 1);
-	bid.reserve(iter->second.size() / 2 + 1);
+		// bytes after the end of the stream are ignored
+		gzip->done = ret == Z_STREAM_END;
 
-	for (const auto& s : iter->second) {
-		if (is_ask(s)) ask.push_back(s);
-		if (is_bid(s)) bid.push_back(s);
+		if (auto produced = size - stream.avail_out) return produced;
 	}
-
-	return { std::move(ask), std::move(bid) };
-}
-
-void
-BatchOrganizer::delete_key(const std::string& name) {
-	const auto key = get_key(name);
-	dict.erase(key);
 }
 
 bool
-MultiFileReader::getline(std::string& out) {
-	auto clear_stream = [&]() {
-		curr.close();
-		curr.clear();
-	};
-
+MultiFileReader::getline(std::string_view& out) {
 	while (true) {
-		if (!curr.is_open()) {
-			if (curr_idx >= files.size()) return false;
+		auto* data = reinterpret_cast<char*>(buf.data());
+
+		if (begin < end) {
+			if (auto* nl = static_cast<char*>(std::memchr(data + begin, '\n', end - begin))) {
+				out = std::string_view(data + begin, static_cast<size_t>(nl - data) - begin);
+				begin = static_cast<size_t>(nl - data) + 1;
+				return true;
+			}
+		}
 
-			clear_stream();
-			auto path = dir / files[curr_idx];
-			curr.open(path, std::ios::binary);
+		if (fd >= 0) {
+			// keep the partial line and fill the rest of the chunk
+			if (begin > 0) {
+				std::memmove(data, data + begin, end - begin);
+				end -= begin;
+				begin = 0;
+			}
+
+			if (end == buf.size()) {
+				throw std::runtime_error("Line longer than read buffer in " + files[curr_idx]);
+			}
+
+			if (auto got = read_some(data + end, buf.size() - end)) {
+				end += got;
+				continue;
+			}
+
+			::close(fd);
+			fd = -1;
+			gzip.reset();
+			++curr_idx;
+
+			// last line of the file without a trailing newline
+			if (begin < end) {
+				out = std::string_view(data + begin, end - begin);
+				begin = end;
+				return true;
+			}
+
+			continue;
+		}
 
-			if (!curr) throw std::runtime_error("Failed to open " + files[curr_idx]);
+		if (curr_idx >= files.size()) {
+			buf.reset();
+			return false;
 		}
 
-		if (std::getline(curr, out)) return true;
+		if (!buf.data()) buf = BufferPool::instance().acquire();
+		begin = end = 0;
 
-		clear_stream();
-		++curr_idx;
-	}
+		auto path = dir / files[curr_idx];
+		fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0) throw std::runtime_error("Failed to open " + files[curr_idx]);
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-	return false;
-}
\ No newline at end of file
+		if (path.extension() == ".gz") gzip = std::make_unique<Gzip>();
+	}
+}
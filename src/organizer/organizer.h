@@ -1,61 +1,47 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 #include <vector>
-#include <fstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
-namespace fs = std::filesystem;
-
-class BatchOrganizer {
-public:
-	explicit
-	BatchOrganizer(const fs::path& directory) {
-		populate_dict(directory);
-	}
+#include "../memory/buffer_pool.h"
 
-	std::pair<std::vector<std::string>, std::vector<std::string>>
-	get_batch(const std::string& filename) const;
-
-	void
-	delete_key(const std::string& key);
+namespace fs = std::filesystem;
 
+// Reads a list of files as one stream of lines. Files are read in pool
+// buffer sized chunks and lines are handed out as views into the chunk.
+// Files ending in .gz are inflated on the way in.
+class MultiFileReader {
 private:
-	std::unordered_map<std::string, std::vector<std::string>> dict;
-
-	bool
-	is_ask(const std::string& filename) const;
-
-	bool
-	is_bid(const std::string& filename) const;
+	struct Gzip;
 
-	std::string
-	get_key(const std::string& filename) const;
+	std::vector<std::string> files;
+	size_t curr_idx;
+	fs::path dir;
 
-	int
-	extract_hour(const std::string& filename) const;
+	int fd = -1;
+	std::unique_ptr<Gzip> gzip;
+	BufferPool::Buffer buf;
+	size_t begin = 0;
+	size_t end = 0;
 
-	void
-	sort_by_hour(std::vector<std::string>& filenames) const;
+	// bytes of the current file into out; 0 at its end
+	size_t
+	read_some(char* out, size_t size);
 
-	void
-	populate_dict(const fs::path& directory);
-};
+public:
+	MultiFileReader(const std::vector<std::string>& files, const fs::path& dir);
 
-class MultiFileReader {
-private:
-	const std::vector<std::string> files;
-	std::ifstream curr;
-	size_t curr_idx;
-	fs::path dir;
+	MultiFileReader(MultiFileReader&& other) noexcept;
 
-public:
-	MultiFileReader(const std::vector<std::string>& files, const fs::path& dir):
-		files(files), curr_idx(0), dir{dir} {}
+	MultiFileReader&
+	operator=(MultiFileReader&&) = delete;
 
-	MultiFileReader(MultiFileReader&&) = default;
+	~MultiFileReader();
 
+	// out stays valid until the next call
 	bool
-	getline(std::string& out);
-};
\ No newline at end of file
+	getline(std::string_view& out);
+};
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
+
+#include <spdlog/sinks/basic_file_sink.h>
+
+#include "pipeline.h"
+#include "../decompress/decompress.h"
+#include "../dotenv/dotenv.h"
+#include "../memory/buffer_pool.h"
+#include "../organizer/organizer.h"
+#include "../transform/aggregate.h"
+#include "../transform/transform.h"
+#include "../writer/writer.h"
+
+namespace {
+
+fs::path
+require_env(const char* name) {
+	const char* val = std::getenv(name);
+	if (!val) throw std::runtime_error(std::string("missing environment variable ") + name);
+	return val;
+}
+
+void
+log_pool_stats(spdlog::logger& logger) {
+	const auto stats = BufferPool::instance().stats();
+	logger.info(
+		"buffer pool: acquires={}, hit_rate={:.1f}%, peak={} buffers ({} MB)",
+		stats.acquires,
+		stats.hit_rate() * 100.0,
+		stats.peak_in_use,
+		stats.peak_in_use * BufferPool::BUFFER_SIZE >> 20
+	);
+}
+
+// a bounded range redoes the files of its own hours; the rest of their days
+// is only fetched when missing
+bool
+redo(const Settings& settings, const std::string& name) {
+	return settings.redo && settings.range.selects(name);
+}
+
+// done, and the file still has the size recorded for it: a file truncated or
+// replaced since is done again
+bool
+intact(const Journal& journal, Stage stage, const std::string& unit, const fs::path& path) {
+	std::error_code ec;
+	const auto size = fs::file_size(path, ec);
+
+	return !ec && journal.size(stage, unit) == size;
+}
+
+}
+
+Settings
+load_settings(const std::string& symbol) {
+	Settings s{};
+
+	s.log_path = require_env("LOGS_FOLDER_PATH");
+	s.symbol = symbol;
+
+	s.ftp = FtpConfig {
+		.url = require_env("FTP_URL").string(),
+		.username = require_env("FTP_USERNAME").string(),
+		.password = require_env("FTP_PASSWORD").string(),
+		.verbose = true,
+	};
+
+	s.download_dir = require_env("FTP_DOWNLOAD_FOLDER") / symbol;
+	s.unzipped_dir = require_env("DECOMPRESSED_FOLDER");
+	s.db_path = require_env("DB_PATH");
+
+	const char* journal_env = std::getenv("JOURNAL_FOLDER_PATH");
+	const fs::path journal_dir = journal_env ? fs::path{journal_env} : s.log_path / "journal";
+	s.journal_path = journal_dir / (symbol + ".journal");
+
+	// where run and export leave memory-mappable candle files
+	const char* columnar_env = std::getenv("COLUMNAR_FOLDER");
+	if (columnar_env && *columnar_env) s.columnar_dir = columnar_env;
+
+	// inflate while downloading instead of writing and re-reading the .gz
+	s.stream_inflate = env_flag("FTP_STREAM_INFLATE");
+	s.keep_compressed = env_flag("FTP_KEEP_COMPRESSED");
+
+	// parse ASK and BID on their own threads, merging on this one
+	s.threaded_parse = env_flag("THREADED_PARSE");
+
+	// RANGE_FROM / RANGE_TO limit every stage to those hours, e.g. 2024-03-04
+	// to 2024-03-10 or 2024-03-04_08 to 2024-03-04_17. A bounded range is a
+	// repair: its files are downloaded, inflated and written again even when
+	// the journal has them as done. The rest of their days is fetched when
+	// missing and aggregated too, so the first candles of the range start from
+	// the same ask/bid state as a full rebuild; only the range is written
+	const char* from = std::getenv("RANGE_FROM");
+	const char* to = std::getenv("RANGE_TO");
+	s.range = parse_hour_range(from ? from : "", to ? to : "");
+	s.redo = s.range.bounded();
+
+	// STORAGE_MODE=append skips the time index, see StorageMode
+	const char* storage = std::getenv("STORAGE_MODE");
+	const std::string mode = storage ? storage : "";
+	if (mode == "append") s.storage = StorageMode::Append;
+	else if (!mode.empty() && mode != "upsert") throw std::runtime_error("unknown STORAGE_MODE " + mode);
+
+	// how often follow mode lists the server for grown hour files
+	s.follow_poll_ms = env_number("FOLLOW_POLL_MS", 5000);
+
+	// back buffer pool slabs with transparent huge pages
+	s.huge_pages = env_flag("POOL_HUGE_PAGES");
+
+	// merge overlapping or out of order hour files instead of concatenating
+	s.merge_hours = env_flag("MERGE_HOUR_FILES");
+	s.merge_lookback_ms = env_number("MERGE_LOOKBACK_MS", 1000);
+
+	return s;
+}
+
+bool
+with_logger(const fs::path& root,
+			const std::string& category,
+			const std::string& symbol,
+			const LogAction& action)
+{
+	const auto dir = root / category;
+	fs::create_directories(dir);
+
+	const auto file = dir / symbol;
+	const auto name = category + "_" + symbol;
+
+	auto logger = spdlog::get(name);
+	if (!logger) {
+		logger = spdlog::basic_logger_mt(
+			name, file.string(), false
+		);
+	}
+
+	try {
+		action(*logger);
+	} catch (const std::exception& e) {
+		logger->error(e.what());
+		logger->flush();
+
+		return false;
+	}
+
+	return true;
+}
+
+std::string
+write_unit(const DayJob& day) {
+	char masks[20];
+	std::snprintf(masks, sizeof(masks), "_%06x_%06x", day.ask_hours, day.bid_hours);
+
+	return day.symbol + "_" + day.key + masks;
+}
+
+void
+aggregate_day(	const Settings& settings,
+				const DayJob& day,
+				std::pmr::vector<Candle>& out,
+				MergeStats* stats)
+{
+	// one set of counters per side: with threaded_parse each side merges on
+	// its own producer thread
+	MergeStats ask_stats{};
+	MergeStats bid_stats{};
+
+	auto side = [&](const std::vector<std::string>& files, MergeStats& side_stats) -> std::unique_ptr<TickSource> {
+		if (settings.merge_hours) {
+			return std::make_unique<MergingTickSource>(files, settings.unzipped_dir, settings.merge_lookback_ms, &side_stats);
+		}
+		return std::make_unique<FileTickSource>(MultiFileReader(files, settings.unzipped_dir));
+	};
+
+	const auto f = settings.frame;
+	{
+		AskBidMerger reader {
+			make_tick_source(side(day.ask, ask_stats), settings.threaded_parse),
+			make_tick_source(side(day.bid, bid_stats), settings.threaded_parse),
+			f
+		};
+
+		out.reserve(out.size() + std::min<size_t>(24 * 60 * 60 * 1000 / f + 1, 1 << 17));
+		aggregate_candles(reader, f, out);
+	}
+
+	// the producer threads are joined once the reader is gone
+	if (stats) {
+		stats->duplicates += ask_stats.duplicates + bid_stats.duplicates;
+		stats->late += ask_stats.late + bid_stats.late;
+	}
+}
+
+void
+download_stage(const Settings& settings, Journal& journal, spdlog::logger& logger) {
+	const auto& symbol = settings.symbol;
+	const auto& download_symbol_dir = settings.download_dir;
+
+	FtpClient client;
+	client.connect(settings.ftp);
+
+	auto remote_files = client.list_files(symbol);
+	const auto listed = remote_files.size();
+
+	const auto days = settings.range.whole_days();
+	std::erase_if(remote_files, [&](const std::string& name) { return !days.selects(name); });
+	logger.info(
+		"Downloading batch: symbol={}, count={}, listed={}",
+		symbol,
+		remote_files.size(),
+		listed
+	);
+
+	fs::create_directories(download_symbol_dir);
+	fs::create_directories(settings.unzipped_dir);
+
+	for (const auto& filename : remote_files) {
+		if (settings.stream_inflate) {
+			const auto out_path = settings.unzipped_dir / fs::path(filename).stem();
+			if (!redo(settings, filename) && intact(journal, Stage::Inflate, filename, out_path)) continue;
+
+			logger.info("Downloading and inflating {}", filename);
+			client.download_inflated(
+				symbol, filename, out_path,
+				settings.keep_compressed ? download_symbol_dir : fs::path{}
+			);
+
+			if (settings.keep_compressed) {
+				journal.record(Stage::Download, filename, fs::file_size(download_symbol_dir / filename));
+			}
+			journal.record(Stage::Inflate, filename, fs::file_size(out_path));
+			continue;
+		}
+
+		const auto local_path = download_symbol_dir / filename;
+		if (!redo(settings, filename) && intact(journal, Stage::Download, filename, local_path)) continue;
+
+		logger.info("Downloading {}", filename);
+		client.download_to_file(symbol, filename, download_symbol_dir);
+		journal.record(Stage::Download, filename, fs::file_size(local_path));
+	}
+}
+
+void
+decompress_stage(const Settings& settings, Journal& journal, spdlog::logger& logger) {
+	const auto& unzipped_dir = settings.unzipped_dir;
+	fs::create_directories(unzipped_dir);
+
+	if (!fs::exists(settings.download_dir)) return;
+
+	for (const auto& entry : fs::directory_iterator(settings.download_dir)) {
+		auto gz_path = entry.path();
+		auto out_path = unzipped_dir / gz_path.stem().string();
+
+		const auto gz_name = gz_path.filename().string();
+		if (!settings.range.whole_days().selects(gz_name)) continue;
+		if (!redo(settings, gz_name) && intact(journal, Stage::Inflate, gz_name, out_path)) continue;
+
+		std::ifstream in(gz_path, std::ios::binary);
+		if (!in) throw std::runtime_error("failed to open input: " + gz_path.string());
+
+		std::ofstream out(out_path, std::ios::binary);
+		if (!out) throw std::runtime_error("failed to open output: " + out_path.string());
+
+		if (!decompress_gzip(in, out, logger)) {
+			out.close();
+			fs::remove(out_path);
+			continue;
+		}
+
+		out.close();
+		if (!out) {
+			fs::remove(out_path);
+			throw std::runtime_error("failed to write output: " + out_path.string());
+		}
+		journal.record(Stage::Inflate, gz_name, fs::file_size(out_path));
+	}
+
+	log_pool_stats(logger);
+}
+
+CandleSpan
+write_stage(const Settings& settings,
+			Journal& journal,
+			spdlog::logger& logger,
+			const fs::path& db_path,
+			Shard shard)
+{
+	const auto& symbol = settings.symbol;
+	const auto& unzipped_dir = settings.unzipped_dir;
+
+	// whole days, so the candles of a range match those of a full rebuild
+	const auto& range = settings.range;
+	const auto plan = plan_batches(unzipped_dir, range.whole_days());
+
+	for (const auto& name : plan.unrecognized) {
+		logger.warn("Skipping unrecognized file {}", name);
+	}
+
+	// positions count only this symbol's complete days, so every worker
+	// derives the same assignment from the same directory
+	std::size_t position = 0;
+
+	// the candles of one day live in the arena, which is rewound per day
+	BatchArena arena{};
+	CandleWriter writer{db_path, symbol, settings.storage};
+
+	// a bounded range goes in as one transaction, so a repaired week is
+	// never half old and half new; its journal entries follow the commit
+	const bool atomic = range.bounded();
+	std::vector<std::pair<std::string, std::uint64_t>> uncommitted{};
+	std::size_t days_written = 0;
+	CandleSpan written{};
+
+	for (const auto& day : plan.days) {
+		if (day.symbol != symbol) continue;
+
+		if (!day.complete()) {
+			logger.warn(
+				"Skipping {} {}: ask_files={}, bid_files={}",
+				day.symbol, day.key, day.ask.size(), day.bid.size()
+			);
+			continue;
+		}
+
+		if (!shard.owns(position++)) continue;
+
+		if (auto missing = day.missing_hours()) {
+			logger.warn("{} {}: hours missing on one side, mask={:#08x}", day.symbol, day.key, missing);
+		}
+
+		const auto unit = write_unit(day);
+		if (!settings.redo && journal.done(Stage::Write, unit)) continue;
+
+		arena.reset();
+		std::pmr::vector<Candle> candles{&arena};
+
+		MergeStats dropped{};
+		aggregate_day(settings, day, candles, &dropped);
+
+		// a day only partly inside the range keeps its other hours as stored
+		const bool whole_day = range.contains(day.date, 0) && range.contains(day.date, 23);
+		if (!whole_day) {
+			const auto first = range.first_ms();
+			const auto last = range.last_ms();
+			std::erase_if(candles, [&](const Candle& c) { return c.time < first || c.time > last; });
+		}
+
+		writer.append(candles);
+		written.add(candles);
+		++days_written;
+
+		if (dropped.duplicates || dropped.late) {
+			logger.warn(
+				"{} {}: dropped {} duplicate and {} late tick(s) merging hour files",
+				day.symbol, day.key, dropped.duplicates, dropped.late
+			);
+		}
+
+		if (atomic) {
+			// the unit names the whole day, which was not all written
+			if (whole_day) uncommitted.emplace_back(unit, candles.size());
+			continue;
+		}
+
+		writer.commit();
+		journal.record(Stage::Write, unit, candles.size());
+	}
+
+	writer.commit();
+	for (const auto& [unit, count] : uncommitted) journal.record(Stage::Write, unit, count);
+
+	if (atomic) logger.info("Upserted {} day(s) in one transaction", days_written);
+
+	logger.info("day arena peak: {} KB", arena.peak_bytes() >> 10);
+	log_pool_stats(logger);
+
+	return written;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "../ftp/ftp_client.h"
+#include "../journal/journal.h"
+#include "../planner/planner.h"
+#include "../transform/merging_source.h"
+#include "../transform/transform.h"
+#include "../writer/writer.h"
+
+namespace fs = std::filesystem;
+
+using LogAction = std::function<void(spdlog::logger&)>;
+
+// Everything the stages read from the environment.
+struct Settings {
+	fs::path log_path;
+	FtpConfig ftp;
+	std::string symbol;
+
+	fs::path download_dir;	// FTP_DOWNLOAD_FOLDER/<symbol>
+	fs::path unzipped_dir;
+	fs::path db_path;
+	fs::path journal_path;
+	fs::path columnar_dir;	// empty unless COLUMNAR_FOLDER is set
+
+	std::int64_t frame = 15 * 1000;
+	HourRange range{};
+	bool redo = false;		// ignore the journal for the units in range
+	StorageMode storage = StorageMode::Upsert;
+	long long follow_poll_ms = 5000;
+	std::int64_t merge_lookback_ms = 1000;
+
+	bool stream_inflate = false;
+	bool keep_compressed = false;
+	bool threaded_parse = false;
+	bool huge_pages = false;
+	bool merge_hours = false;
+};
+
+Settings
+load_settings(const std::string& symbol);
+
+// Slice of the day plan handled by one worker: every day whose position in
+// the plan is index modulo count.
+struct Shard {
+	std::size_t index = 0;
+	std::size_t count = 1;
+
+	bool
+	owns(std::size_t position) const { return position % count == index; }
+};
+
+// Inclusive range of the candle times written by a stage, empty when
+// nothing was written.
+struct CandleSpan {
+	std::int64_t first = INT64_MAX;
+	std::int64_t last = INT64_MIN;
+
+	bool
+	empty() const { return first > last; }
+
+	// candles in ascending time order
+	void
+	add(std::span<const Candle> candles) {
+		if (candles.empty()) return;
+		first = std::min(first, candles.front().time);
+		last = std::max(last, candles.back().time);
+	}
+};
+
+bool
+with_logger(const fs::path& root,
+			const std::string& category,
+			const std::string& symbol,
+			const LogAction& action);
+
+// Identifies a written day together with the hours it was built from, so a
+// day that later gains hour files is written again.
+std::string
+write_unit(const DayJob& day);
+
+// Builds the candles of one complete day from its decompressed hour files.
+// With settings.merge_hours the hour files of a side are merged rather than
+// concatenated, and the dropped ticks are counted into stats when given.
+void
+aggregate_day(	const Settings& settings,
+				const DayJob& day,
+				std::pmr::vector<Candle>& out,
+				MergeStats* stats = nullptr);
+
+void
+download_stage(const Settings& settings, Journal& journal, spdlog::logger& logger);
+
+void
+decompress_stage(const Settings& settings, Journal& journal, spdlog::logger& logger);
+
+// Returns the span of the candles written, for exporting just those.
+CandleSpan
+write_stage(const Settings& settings,
+			Journal& journal,
+			spdlog::logger& logger,
+			const fs::path& db_path,
+			Shard shard = {});
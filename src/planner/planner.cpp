@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <stdexcept>
+
+#include "planner.h"
+
+namespace {
+
+// Compact per-file record; the sort never touches the names themselves.
+// order packs symbol | date | side | hour so ordering is one integer compare.
+struct Entry {
+	std::uint64_t order;
+	std::uint32_t name;
+	std::uint16_t key_pos;
+
+	std::uint16_t symbol() const { return static_cast<std::uint16_t>(order >> 48); }
+	std::uint32_t date()   const { return static_cast<std::uint32_t>(order >> 8); }
+	Side side()            const { return static_cast<Side>((order >> 5) & 1); }
+	std::uint8_t hour()    const { return order & 0x1f; }
+};
+
+std::uint64_t
+pack_order(std::uint16_t symbol, std::uint32_t date, Side side, std::uint8_t hour) {
+	return (std::uint64_t{symbol} << 48)
+		| (std::uint64_t{date} << 8)
+		| (static_cast<std::uint64_t>(side) << 5)
+		| hour;
+}
+
+template <typename T>
+bool
+parse_number(std::string_view s, T& out) {
+	if (s.empty()) return false;
+
+	auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+	return ec == std::errc{} && ptr == s.data() + s.size();
+}
+
+bool
+parse_date(std::string_view key, std::uint32_t& out) {
+	if (key.size() != 10 || key[4] != '-' || key[7] != '-') return false;
+
+	std::uint32_t y, m, d;
+	if (!parse_number(key.substr(0, 4), y)) return false;
+	if (!parse_number(key.substr(5, 2), m)) return false;
+	if (!parse_number(key.substr(8, 2), d)) return false;
+
+	if (m < 1 || m > 12 || d < 1 || d > 31) return false;
+
+	out = y * 10000 + m * 100 + d;
+	return true;
+}
+
+// yyyymmddhh to the epoch ms the hour starts at
+std::int64_t
+hour_start_ms(std::uint32_t at) {
+	using namespace std::chrono;
+
+	const auto date = at / 100;
+	const sys_days day = year{static_cast<int>(date / 10000)} / month{date / 100 % 100} / std::chrono::day{date % 100};
+
+	return duration_cast<milliseconds>(day.time_since_epoch() + hours{at % 100}).count();
+}
+
+std::uint32_t
+parse_bound(std::string_view bound, std::uint8_t default_hour) {
+	std::uint32_t date = 0;
+	if (!parse_date(bound.substr(0, 10), date)) {
+		throw std::invalid_argument("bad date in range bound: " + std::string(bound));
+	}
+
+	if (bound.size() == 10) return date * 100 + default_hour;
+
+	// exactly yyyy-mm-dd_hh, as in the file names
+	unsigned hour = 0;
+	if (bound.size() != 13 || bound[10] != '_' || !parse_number(bound.substr(11), hour) || hour > 23) {
+		throw std::invalid_argument("bad hour in range bound: " + std::string(bound));
+	}
+
+	return date * 100 + hour;
+}
+
+}
+
+std::optional<FileName>
+parse_file_name(std::string_view name) {
+	auto first  = name.find('_');
+	if (first == std::string_view::npos) return std::nullopt;
+
+	auto second = name.find('_', first + 1);
+	if (second == std::string_view::npos) return std::nullopt;
+
+	auto third  = name.find('_', second + 1);
+	if (third == std::string_view::npos) return std::nullopt;
+
+	auto dot = std::min(name.find('.', third + 1), name.size());
+
+	FileName out{};
+	out.symbol = name.substr(0, first);
+	out.key = name.substr(second + 1, third - (second + 1));
+
+	const auto side = name.substr(first + 1, second - (first + 1));
+	if (side == "ASK") out.side = Side::Ask;
+	else if (side == "BID") out.side = Side::Bid;
+	else return std::nullopt;
+
+	if (out.symbol.empty()) return std::nullopt;
+	if (!parse_date(out.key, out.date)) return std::nullopt;
+
+	unsigned hour = 0;
+	if (!parse_number(name.substr(third + 1, dot - (third + 1)), hour)) return std::nullopt;
+	if (hour > 23) return std::nullopt;
+
+	out.hour = static_cast<std::uint8_t>(hour);
+	return out;
+}
+
+bool
+HourRange::selects(std::string_view name) const {
+	if (!bounded()) return true;
+
+	auto parsed = parse_file_name(name);
+	return parsed && contains(parsed->date, parsed->hour);
+}
+
+std::int64_t
+HourRange::first_ms() const {
+	return first == 0 ? INT64_MIN : hour_start_ms(first);
+}
+
+std::int64_t
+HourRange::last_ms() const {
+	return last == UINT32_MAX ? INT64_MAX : hour_start_ms(last) + 60 * 60 * 1000 - 1;
+}
+
+HourRange
+parse_hour_range(std::string_view from, std::string_view to) {
+	HourRange range{};
+
+	if (!from.empty()) range.first = parse_bound(from, 0);
+	if (!to.empty()) range.last = parse_bound(to, 23);
+
+	if (range.first > range.last) {
+		throw std::invalid_argument("range starts after it ends: " + std::string(from) + " > " + std::string(to));
+	}
+
+	return range;
+}
+
+std::uint32_t
+DayJob::missing_hours() const {
+	const auto seen = ask_hours | bid_hours;
+	if (seen == 0) return 0;
+
+	const int first = std::countr_zero(seen);
+	const int last  = 31 - std::countl_zero(seen);
+
+	const std::uint32_t span = ((2u << last) - 1) & ~((1u << first) - 1);
+	return span & ~(ask_hours & bid_hours);
+}
+
+BatchPlan
+plan_batches(std::vector<std::string> names, const HourRange& range) {
+	BatchPlan plan{};
+
+	std::vector<std::string_view> symbols{};
+	std::vector<Entry> entries{};
+	entries.reserve(names.size());
+
+	for (std::uint32_t i = 0; i < names.size(); ++i) {
+		auto parsed = parse_file_name(names[i]);
+		if (!parsed) {
+			plan.unrecognized.push_back(std::move(names[i]));
+			continue;
+		}
+
+		if (!range.contains(parsed->date, parsed->hour)) continue;
+
+		auto it = std::find(symbols.begin(), symbols.end(), parsed->symbol);
+		if (it == symbols.end()) it = symbols.insert(symbols.end(), parsed->symbol);
+
+		const auto symbol = static_cast<std::uint16_t>(it - symbols.begin());
+
+		entries.push_back(Entry {
+			.order = pack_order(symbol, parsed->date, parsed->side, parsed->hour),
+			.name = i,
+			.key_pos = static_cast<std::uint16_t>(parsed->key.data() - names[i].data()),
+		});
+	}
+
+	// rank symbols alphabetically so the plan order does not depend on
+	// directory iteration order
+	std::vector<std::uint16_t> rank(symbols.size());
+	{
+		std::vector<std::uint16_t> order(symbols.size());
+		for (std::uint16_t i = 0; i < order.size(); ++i) order[i] = i;
+
+		std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+			return symbols[a] < symbols[b];
+		});
+		for (std::uint16_t r = 0; r < order.size(); ++r) rank[order[r]] = r;
+	}
+
+	for (auto& e : entries) {
+		e.order = pack_order(rank[e.symbol()], e.date(), e.side(), e.hour());
+	}
+
+	// the views point into names, which are moved out below
+	std::vector<std::string> sorted(symbols.begin(), symbols.end());
+	std::sort(sorted.begin(), sorted.end());
+
+	// copies of one hour sort plain .log before .log.gz, so the copy kept
+	// below never depends on directory order
+	std::stable_sort(entries.begin(), entries.end(), [&](const Entry& a, const Entry& b) {
+		if (a.order != b.order) return a.order < b.order;
+
+		const bool a_gz = names[a.name].ends_with(".gz");
+		const bool b_gz = names[b.name].ends_with(".gz");
+		if (a_gz != b_gz) return b_gz;
+
+		return names[a.name] < names[b.name];
+	});
+
+	DayJob* job = nullptr;
+	std::uint16_t job_symbol = 0;
+
+	for (const auto& e : entries) {
+		auto& name = names[e.name];
+
+		if (!job || e.date() != job->date || e.symbol() != job_symbol) {
+			job = &plan.days.emplace_back();
+			job_symbol = e.symbol();
+
+			job->symbol = sorted[job_symbol];
+			job->key = name.substr(e.key_pos, 10);
+			job->date = e.date();
+		}
+
+		const auto bit = 1u << e.hour();
+		auto& hours = e.side() == Side::Ask ? job->ask_hours : job->bid_hours;
+		auto& files = e.side() == Side::Ask ? job->ask : job->bid;
+
+		// the same hour twice (e.g. a stale copy) would feed duplicate ticks
+		if (hours & bit) {
+			plan.unrecognized.push_back(std::move(name));
+			continue;
+		}
+
+		hours |= bit;
+		files.push_back(std::move(name));
+	}
+
+	return plan;
+}
+
+BatchPlan
+plan_batches(const fs::path& directory, const HourRange& range) {
+	std::vector<std::string> names{};
+
+	for (const auto& entry : fs::directory_iterator(directory)) {
+		if (!entry.is_regular_file()) continue;
+		names.push_back(entry.path().filename().string());
+	}
+
+	return plan_batches(std::move(names), range);
+}
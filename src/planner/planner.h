@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class Side : std::uint8_t {
+	Ask,
+	Bid,
+};
+
+// Fields of a Darwinex hour file name, e.g. ADAUSD_ASK_2023-05-01_13.log(.gz).
+// Views point into the parsed name and share its lifetime.
+struct FileName {
+	std::string_view symbol;
+	std::string_view key;	// the date as written in the name, 2023-05-01
+
+	std::uint32_t date;		// yyyymmdd
+	std::uint8_t hour;
+	Side side;
+};
+
+std::optional<FileName>
+parse_file_name(std::string_view name);
+
+// Inclusive range of hours compared as yyyymmddhh; the default selects
+// everything.
+struct HourRange {
+	std::uint32_t first = 0;
+	std::uint32_t last = UINT32_MAX;
+
+	bool
+	bounded() const { return first != 0 || last != UINT32_MAX; }
+
+	bool
+	contains(std::uint32_t date, std::uint8_t hour) const {
+		const auto at = date * 100 + hour;
+		return at >= first && at <= last;
+	}
+
+	// names that do not parse are only selected by an unbounded range
+	bool
+	selects(std::string_view name) const;
+
+	// the range widened to the whole days it touches
+	HourRange
+	whole_days() const {
+		return HourRange { .first = first / 100 * 100, .last = last == UINT32_MAX ? last : last / 100 * 100 + 23 };
+	}
+
+	// epoch ms of the first and last millisecond covered; open ends are
+	// INT64_MIN and INT64_MAX
+	std::int64_t
+	first_ms() const;
+
+	std::int64_t
+	last_ms() const;
+};
+
+// Bounds are written like the file names, 2023-05-01 or 2023-05-01_13. A
+// bare date covers the whole day, so from starts at hour 0 and to ends at
+// hour 23; an empty bound leaves that side open. Throws
+// std::invalid_argument on malformed bounds.
+HourRange
+parse_hour_range(std::string_view from, std::string_view to);
+
+struct DayJob {
+	std::string symbol;
+	std::string key;
+	std::uint32_t date = 0;
+
+	// hour ordered file names per side
+	std::vector<std::string> ask;
+	std::vector<std::string> bid;
+
+	// bit h is set when hour h is present
+	std::uint32_t ask_hours = 0;
+	std::uint32_t bid_hours = 0;
+
+	bool
+	complete() const {
+		return ask_hours != 0 && bid_hours != 0;
+	}
+
+	// Hours between the first and last one seen on either side that are
+	// missing on at least one side.
+	std::uint32_t
+	missing_hours() const;
+};
+
+struct BatchPlan {
+	std::vector<DayJob> days;				// ordered by symbol, then date
+	std::vector<std::string> unrecognized;	// unparsable names and duplicate hours
+};
+
+// Names outside range are left out of the plan entirely. Of two copies of
+// one hour the plain .log is planned and the .log.gz goes to unrecognized.
+BatchPlan
+plan_batches(std::vector<std::string> names, const HourRange& range = {});
+
+BatchPlan
+plan_batches(const fs::path& directory, const HourRange& range = {});
@@ -0,0 +1,64 @@
+#include <vector>
+
+#include "replay.h"
+
+TickReplay::TickReplay(const fs::path& dir, const std::string& symbol, const ReplayOptions& options):
+	mode(options.mode)
+{
+	std::vector<std::string> ask_names{};
+	std::vector<std::string> bid_names{};
+
+	// days come out in date order and their files in hour order
+	for (auto& day : plan_batches(dir, options.range).days) {
+		if (day.symbol != symbol) continue;
+
+		ask_names.insert(ask_names.end(), day.ask.begin(), day.ask.end());
+		bid_names.insert(bid_names.end(), day.bid.begin(), day.bid.end());
+	}
+
+	ask_count = ask_names.size();
+	bid_count = bid_names.size();
+
+	auto ask_source = make_tick_source(MultiFileReader(ask_names, dir), options.read_ahead);
+	auto bid_source = make_tick_source(MultiFileReader(bid_names, dir), options.read_ahead);
+
+	if (mode == ReplayMode::Mid) {
+		// the frame only matters for candles, which are not asked for here
+		merger = std::make_unique<AskBidMerger>(std::move(ask_source), std::move(bid_source), 1);
+		return;
+	}
+
+	ask = std::make_unique<TickStream>(std::move(ask_source));
+	bid = std::make_unique<TickStream>(std::move(bid_source));
+
+	has_ask = ask->next(curr_ask);
+	has_bid = bid->next(curr_bid);
+}
+
+TickReplay::~TickReplay() = default;
+
+bool
+TickReplay::next(ReplayTick& out) {
+	if (merger) {
+		TickEntry tick{};
+		if (!merger->get_next_mid_tick(tick)) return false;
+
+		out = ReplayTick { .epoch = tick.epoch, .price = tick.price, .size = tick.size, .kind = TickKind::Mid };
+		return true;
+	}
+
+	if (!has_ask && !has_bid) return false;
+
+	// bid first on equal epochs, like AskBidMerger
+	const bool use_bid = !has_ask || (has_bid && curr_bid.epoch <= curr_ask.epoch);
+
+	if (use_bid) {
+		out = ReplayTick { .epoch = curr_bid.epoch, .price = curr_bid.price, .size = curr_bid.size, .kind = TickKind::Bid };
+		has_bid = bid->next(curr_bid);
+	} else {
+		out = ReplayTick { .epoch = curr_ask.epoch, .price = curr_ask.price, .size = curr_ask.size, .kind = TickKind::Ask };
+		has_ask = ask->next(curr_ask);
+	}
+
+	return true;
+}
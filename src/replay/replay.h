@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "../planner/planner.h"
+#include "../transform/transform.h"
+
+namespace fs = std::filesystem;
+
+enum class ReplayMode {
+	Mid,	// ask and bid merged into mid ticks, as candles are built from
+	Raw,	// the quotes of both sides interleaved by time
+};
+
+enum class TickKind : std::uint8_t {
+	Mid,
+	Ask,
+	Bid,
+};
+
+struct ReplayTick {
+	std::int64_t epoch;
+	double price;
+	double size;
+	TickKind kind;
+};
+
+struct ReplayOptions {
+	ReplayMode mode = ReplayMode::Mid;
+	HourRange range{};
+
+	// inflate and parse each side on its own thread, ahead of the consumer
+	bool read_ahead = true;
+};
+
+// Replays the Darwinex hour files of one symbol found in dir, plain (.log)
+// or compressed (.log.gz), in time order across days. Hours outside
+// options.range are skipped.
+//
+//   TickReplay replay{"/data/ticks", "EURUSD", { .range = parse_hour_range("2024-03-04", "") }};
+//   for (const auto& tick : replay) ...
+class TickReplay {
+public:
+	TickReplay(const fs::path& dir, const std::string& symbol, const ReplayOptions& options = {});
+
+	TickReplay(const TickReplay&) = delete;
+
+	TickReplay&
+	operator=(const TickReplay&) = delete;
+
+	~TickReplay();
+
+	// false once the range is exhausted
+	bool
+	next(ReplayTick& out);
+
+	// single pass input iterator over next()
+	class iterator {
+	public:
+		using iterator_concept = std::input_iterator_tag;
+		using value_type = ReplayTick;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() = default;
+
+		const ReplayTick&
+		operator*() const { return tick; }
+
+		const ReplayTick*
+		operator->() const { return &tick; }
+
+		iterator&
+		operator++() {
+			if (!replay->next(tick)) replay = nullptr;
+			return *this;
+		}
+
+		void
+		operator++(int) { ++*this; }
+
+		friend bool
+		operator==(const iterator& it, std::default_sentinel_t) { return it.replay == nullptr; }
+
+	private:
+		friend class TickReplay;
+		explicit iterator(TickReplay* replay): replay(replay) { ++*this; }
+
+		TickReplay* replay = nullptr;
+		ReplayTick tick{};
+	};
+
+	iterator
+	begin() { return iterator{this}; }
+
+	std::default_sentinel_t
+	end() const { return {}; }
+
+	// hour files found per side
+	std::size_t
+	ask_files() const { return ask_count; }
+
+	std::size_t
+	bid_files() const { return bid_count; }
+
+private:
+	ReplayMode mode;
+	std::size_t ask_count = 0;
+	std::size_t bid_count = 0;
+
+	std::unique_ptr<AskBidMerger> merger;	// mid mode
+	std::unique_ptr<TickStream> ask;		// raw mode
+	std::unique_ptr<TickStream> bid;
+
+	bool has_ask = false;
+	TickEntry curr_ask{};
+
+	bool has_bid = false;
+	TickEntry curr_bid{};
+};
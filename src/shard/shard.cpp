@@ -0,0 +1,145 @@
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shard.h"
+#include "../writer/writer.h"
+
+extern char** environ;
+
+namespace {
+
+pid_t
+spawn_worker(	const fs::path& self,
+				std::size_t index,
+				std::size_t count,
+				const std::vector<std::string>& extra_args)
+{
+	std::vector<std::string> args {
+		self.string(), "worker", std::to_string(index), std::to_string(count)
+	};
+	args.insert(args.end(), extra_args.begin(), extra_args.end());
+
+	std::vector<char*> argv{};
+	for (auto& arg : args) argv.push_back(arg.data());
+	argv.push_back(nullptr);
+
+	pid_t pid = 0;
+	if (int err = posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ); err != 0) {
+		throw std::runtime_error("failed to spawn shard worker: " + std::string(std::strerror(err)));
+	}
+
+	return pid;
+}
+
+std::string
+describe_status(int status) {
+	if (WIFEXITED(status)) return "exit code " + std::to_string(WEXITSTATUS(status));
+	if (WIFSIGNALED(status)) return "signal " + std::to_string(WTERMSIG(status));
+	return "status " + std::to_string(status);
+}
+
+}
+
+fs::path
+shard_db_path(const fs::path& db_path, Shard shard) {
+	auto name = db_path.stem().string()
+		+ ".shard-" + std::to_string(shard.index)
+		+ "-of-" + std::to_string(shard.count)
+		+ db_path.extension().string();
+
+	return db_path.parent_path() / name;
+}
+
+fs::path
+shard_journal_path(const fs::path& journal_path, Shard shard) {
+	return shard_db_path(journal_path, shard);
+}
+
+std::vector<std::size_t>
+run_shard_workers(	const fs::path& self,
+					std::size_t count,
+					std::uint32_t retries,
+					const std::vector<std::string>& extra_args,
+					spdlog::logger& logger)
+{
+	std::map<pid_t, std::size_t> running{};
+	std::vector<std::uint32_t> attempts(count, 0);
+	std::vector<std::size_t> failed{};
+
+	for (std::size_t i = 0; i < count; ++i) {
+		running[spawn_worker(self, i, count, extra_args)] = i;
+		logger.info("Started shard {}/{}", i, count);
+	}
+
+	while (!running.empty()) {
+		int status = 0;
+		pid_t pid = ::waitpid(-1, &status, 0);
+
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error("waitpid failed: " + std::string(std::strerror(errno)));
+		}
+
+		auto iter = running.find(pid);
+		if (iter == running.end()) continue;
+
+		const auto shard = iter->second;
+		running.erase(iter);
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			logger.info("Shard {}/{} finished", shard, count);
+			continue;
+		}
+
+		if (attempts[shard]++ < retries) {
+			logger.warn("Shard {}/{} failed ({}), retrying", shard, count, describe_status(status));
+			running[spawn_worker(self, shard, count, extra_args)] = shard;
+			continue;
+		}
+
+		logger.error("Shard {}/{} failed ({}), giving up", shard, count, describe_status(status));
+		failed.push_back(shard);
+	}
+
+	return failed;
+}
+
+void
+merge_shards(const Settings& settings, std::size_t count, Journal& journal, spdlog::logger& logger) {
+	std::vector<fs::path> databases{};
+	for (std::size_t i = 0; i < count; ++i) {
+		const auto path = shard_db_path(settings.db_path, Shard{ .index = i, .count = count });
+		if (!fs::exists(path)) continue;
+
+		logger.info("Merging shard {}", path.string());
+		databases.push_back(path);
+	}
+
+	// one transaction for every shard, so a repaired range is never half
+	// merged
+	merge_dbs_into(databases, settings.db_path, settings.symbol, settings.storage);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		const Shard shard{ .index = i, .count = count };
+		const auto path = shard_db_path(settings.db_path, shard);
+		const auto journal_path = shard_journal_path(settings.journal_path, shard);
+
+		// only after the candles: a crash in between merges the shards again
+		// rather than journaling days that are not in the database
+		if (fs::exists(journal_path)) {
+			const auto recorded = journal.merge_from(journal_path);
+			logger.info("Merged {} journal record(s) of shard {}/{}", recorded, i, count);
+		}
+
+		fs::remove(path);
+		fs::remove(fs::path(path.string() + ".wal"));
+		fs::remove(journal_path);
+	}
+}
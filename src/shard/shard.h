@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "../pipeline/pipeline.h"
+
+namespace fs = std::filesystem;
+
+// Shard databases sit next to DB_PATH, so workers on other nodes only need
+// the same shared storage: /data/candles.duckdb -> /data/candles.shard-2-of-8.duckdb
+fs::path
+shard_db_path(const fs::path& db_path, Shard shard);
+
+// Journal a worker records its days in, next to JOURNAL_PATH the same way:
+// it reads the main journal but never opens it for writing.
+fs::path
+shard_journal_path(const fs::path& journal_path, Shard shard);
+
+// Runs `self worker <i> <count> [extra_args...]` for every shard as separate
+// processes, relaunching failed ones up to retries times. Returns the shards
+// that still failed.
+std::vector<std::size_t>
+run_shard_workers(	const fs::path& self,
+					std::size_t count,
+					std::uint32_t retries,
+					const std::vector<std::string>& extra_args,
+					spdlog::logger& logger);
+
+// Folds every shard database that exists into settings.db_path in one
+// transaction, then the shard journals into journal, and removes them once
+// merged.
+void
+merge_shards(const Settings& settings, std::size_t count, Journal& journal, spdlog::logger& logger);
@@ -0,0 +1,51 @@
+#include <array>
+#include <utility>
+
+#include "aggregate.h"
+
+namespace {
+
+using CandleRun = void (*)(AskBidMerger&, std::pmr::vector<Candle>&);
+
+template <std::int64_t Frame>
+void
+run_frame(AskBidMerger& merger, std::pmr::vector<Candle>& out) {
+	FrameAggregator<AskBidMerger, Frame, agg::Ohlc, agg::TickCount> aggregator{merger};
+
+	typename decltype(aggregator)::bar_type bar;
+	while (aggregator.get_next(bar)) out.push_back(to_candle(bar));
+}
+
+constexpr std::array<std::pair<std::int64_t, CandleRun>, 5> runs {{
+	{ 1000,           run_frame<1000> },
+	{ 15 * 1000,      run_frame<15 * 1000> },
+	{ 60 * 1000,      run_frame<60 * 1000> },
+	{ 5 * 60 * 1000,  run_frame<5 * 60 * 1000> },
+	{ 60 * 60 * 1000, run_frame<60 * 60 * 1000> },
+}};
+
+CandleRun
+find_run(std::int64_t frame) {
+	for (const auto& [f, run] : runs) {
+		if (f == frame) return run;
+	}
+	return nullptr;
+}
+
+}
+
+bool
+has_specialized_frame(std::int64_t frame) {
+	return find_run(frame) != nullptr;
+}
+
+void
+aggregate_candles(AskBidMerger& merger, std::int64_t frame, std::pmr::vector<Candle>& out) {
+	if (auto run = find_run(frame)) {
+		run(merger, out);
+		return;
+	}
+
+	Candle c;
+	while (merger.get_next_candle(c)) out.push_back(c);
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+#include "transform.h"
+
+// Aggregates are policies mixed into a Bar. Each one sees the first tick of a
+// bucket through start() and every later one through add(); the source is
+// passed along for aggregates that need more than the mid price. A bar only
+// carries the aggregates it lists, so the others cost nothing.
+namespace agg {
+
+struct Ohlc {
+	double open;
+	double high;
+	double low;
+	double close;
+
+	template <typename Source>
+	void
+	start(const TickEntry& tick, const Source&) {
+		open = high = low = close = tick.price;
+	}
+
+	template <typename Source>
+	void
+	add(const TickEntry& tick, const Source&) {
+		high  = std::max(high, tick.price);
+		low   = std::min(low, tick.price);
+		close = tick.price;
+	}
+};
+
+struct TickCount {
+	std::int64_t tick_count;
+
+	template <typename Source>
+	void
+	start(const TickEntry&, const Source&) { tick_count = 1; }
+
+	template <typename Source>
+	void
+	add(const TickEntry&, const Source&) { ++tick_count; }
+};
+
+// ask - bid at each mid tick
+struct Spread {
+	double spread_sum;
+	double spread_max;
+	std::int64_t spread_count;
+
+	template <typename Source>
+	void
+	start(const TickEntry&, const Source& source) {
+		spread_sum = spread_max = source.spread();
+		spread_count = 1;
+	}
+
+	template <typename Source>
+	void
+	add(const TickEntry&, const Source& source) {
+		const auto s = source.spread();
+		spread_sum += s;
+		spread_max = std::max(spread_max, s);
+		++spread_count;
+	}
+
+	double
+	spread_mean() const { return spread_sum / static_cast<double>(spread_count); }
+};
+
+}
+
+template <typename... Aggs>
+struct Bar : Aggs... {
+	std::int64_t time;
+};
+
+// Buckets mid ticks from Source (anything with get_next_mid_tick) into bars of
+// a compile-time Frame in milliseconds. The bucket start is one division by a
+// constant, which compiles to a multiply and shift; every other tick only
+// compares against the bucket end.
+template <typename Source, std::int64_t Frame, typename... Aggs>
+class FrameAggregator {
+	static_assert(Frame > 0, "frame must be positive");
+
+public:
+	using bar_type = Bar<Aggs...>;
+
+	explicit
+	FrameAggregator(Source& source): source(source) {}
+
+	bool
+	get_next(bar_type& out) {
+		TickEntry tick{};
+
+		if (has_buffered) {
+			tick = buffered;
+			has_buffered = false;
+		} else if (!source.get_next_mid_tick(tick)) {
+			return false;
+		}
+
+		const auto open_time = tick.epoch / Frame * Frame;
+		const auto end_time = open_time + Frame;
+
+		out.time = open_time;
+		(static_cast<Aggs&>(out).start(tick, source), ...);
+
+		while (source.get_next_mid_tick(tick)) {
+			if (tick.epoch >= end_time || tick.epoch < open_time) {
+				buffered = tick;
+				has_buffered = true;
+				break;
+			}
+
+			(static_cast<Aggs&>(out).add(tick, source), ...);
+		}
+
+		return true;
+	}
+
+private:
+	Source& source;
+
+	bool has_buffered = false;
+	TickEntry buffered{};
+};
+
+template <typename B>
+Candle
+to_candle(const B& bar) {
+	static_assert(std::is_base_of_v<agg::Ohlc, B> && std::is_base_of_v<agg::TickCount, B>);
+
+	return Candle {
+		.time = bar.time,
+		.tick_count = bar.tick_count,
+
+		.open  = bar.open,
+		.high  = bar.high,
+		.low   = bar.low,
+		.close = bar.close,
+	};
+}
+
+// Appends all candles of merger to out. The standard frames (1s, 15s, 1m, 5m,
+// 1h) run a FrameAggregator specialized for them; any other frame falls back
+// to AskBidMerger::get_next_candle.
+void
+aggregate_candles(AskBidMerger& merger, std::int64_t frame, std::pmr::vector<Candle>& out);
+
+bool
+has_specialized_frame(std::int64_t frame);
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+#include "merging_source.h"
+
+namespace {
+
+// epoch of the first tick, or INT64_MIN when there is none; read like the
+// merge reads, so .gz hours are inflated
+std::int64_t
+first_epoch(const std::string& file, const fs::path& dir) {
+	MultiFileReader reader({file}, dir);
+	std::string_view line;
+	TickEntry tick{};
+
+	while (reader.getline(line)) {
+		if (parse_tick_line(line, tick)) return tick.epoch;
+	}
+	return INT64_MIN;
+}
+
+}
+
+MergingTickSource::MergingTickSource(	const std::vector<std::string>& files,
+										const fs::path& dir,
+										std::int64_t lookback_ms,
+										MergeStats* stats):
+	dir(dir), lookback(lookback_ms), stats(stats)
+{
+	inputs.reserve(files.size());
+	heap.reserve(files.size());
+
+	for (const auto& file : files) {
+		const auto at = first_epoch(file, dir);
+		heap.push_back(HeapEntry { .epoch = at, .input = static_cast<std::uint32_t>(inputs.size()), .opened = false });
+
+		auto& input = inputs.emplace_back();
+		input.file = file;
+	}
+
+	std::make_heap(heap.begin(), heap.end(), later);
+}
+
+bool
+MergingTickSource::later(const HeapEntry& a, const HeapEntry& b) {
+	if (a.epoch != b.epoch) return a.epoch > b.epoch;
+	return a.input > b.input;
+}
+
+bool
+MergingTickSource::refill(Input& input) {
+	if (input.pos < input.size) return true;
+
+	input.size = input.source->read(input.buf.data(), input.buf.size());
+	input.pos = 0;
+	if (input.size) return true;
+
+	// hand the read buffer back to the pool as soon as a file ends
+	input.source.reset();
+	input.buf = {};
+	return false;
+}
+
+void
+MergingTickSource::sift_top() {
+	const auto n = heap.size();
+	if ((n > 1 && later(heap[0], heap[1])) || (n > 2 && later(heap[0], heap[2]))) {
+		std::pop_heap(heap.begin(), heap.end(), later);
+		std::push_heap(heap.begin(), heap.end(), later);
+	}
+}
+
+bool
+MergingTickSource::pull() {
+	while (!heap.empty()) {
+		auto& top = heap.front();
+		auto& input = inputs[top.input];
+		const auto index = top.input;
+
+		if (!top.opened) {
+			input.source = std::make_unique<FileTickSource>(MultiFileReader({input.file}, dir));
+			input.buf.resize(BLOCK);
+		}
+
+		if (!refill(input)) {
+			std::pop_heap(heap.begin(), heap.end(), later);
+			heap.pop_back();
+			continue;
+		}
+
+		if (!top.opened) {
+			top = HeapEntry { .epoch = input.buf[input.pos].epoch, .input = index, .opened = true };
+			sift_top();
+			continue;
+		}
+
+		// the run ends where another file's head sorts first; on equal
+		// epochs the lower file index goes first
+		HeapEntry bound { .epoch = INT64_MAX, .input = UINT32_MAX, .opened = true };
+		for (size_t child = 1; child < std::min<size_t>(heap.size(), 3); ++child) {
+			if (later(bound, heap[child])) bound = heap[child];
+		}
+		const bool ties_first = index < bound.input;
+
+		do {
+			const auto& tick = input.buf[input.pos];
+			if (tick.epoch > bound.epoch || (tick.epoch == bound.epoch && !ties_first)) break;
+			++input.pos;
+
+			if (has_emitted && tick.epoch < emitted_epoch) {
+				if (stats) ++stats->late;
+				continue;
+			}
+
+			newest = std::max(newest, tick.epoch);
+
+			const Held held { .tick = tick, .input = index };
+			if (window_front == window.size() || window.back().tick.epoch <= tick.epoch) {
+				window.push_back(held);
+			} else {
+				auto at = std::upper_bound(window.begin() + window_front, window.end(), tick.epoch,
+					[](std::int64_t epoch, const Held& h) { return epoch < h.tick.epoch; });
+				window.insert(at, held);
+			}
+		} while (input.pos < input.size);
+
+		if (refill(input)) {
+			top.epoch = input.buf[input.pos].epoch;
+			sift_top();
+		} else {
+			std::pop_heap(heap.begin(), heap.end(), later);
+			heap.pop_back();
+		}
+		return true;
+	}
+
+	return false;
+}
+
+bool
+MergingTickSource::emit(const Held& held, TickEntry& out) {
+	const auto& tick = held.tick;
+
+	if (!has_emitted || tick.epoch != emitted_epoch) {
+		emitted_at_epoch.clear();
+		emitted_epoch = tick.epoch;
+		has_emitted = true;
+		single_input = true;
+	} else if (single_input && emitted_at_epoch.front().input != held.input) {
+		single_input = false;
+	}
+
+	// duplicates need a second file at this epoch
+	for (size_t i = 0; !single_input && i < emitted_at_epoch.size(); ++i) {
+		const auto& seen = emitted_at_epoch[i];
+		if (seen.input != held.input && seen.tick.price == tick.price && seen.tick.size == tick.size) {
+			if (stats) ++stats->duplicates;
+			return false;
+		}
+	}
+
+	emitted_at_epoch.push_back(held);
+	out = tick;
+	return true;
+}
+
+size_t
+MergingTickSource::read(TickEntry* out, size_t capacity) {
+	size_t n = 0;
+
+	while (n < capacity) {
+		const auto limit = drained ? INT64_MAX : newest == INT64_MIN ? INT64_MIN : newest - lookback;
+
+		while (n < capacity && window_front < window.size() && window[window_front].tick.epoch <= limit) {
+			if (emit(window[window_front++], out[n])) ++n;
+		}
+
+		if (n == capacity || drained) break;
+
+		if (window_front == window.size() || window_front >= 4096) {
+			window.erase(window.begin(), window.begin() + window_front);
+			window_front = 0;
+		}
+		if (!pull()) drained = true;
+	}
+
+	return n;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./tick_source.h"
+
+namespace fs = std::filesystem;
+
+struct MergeStats {
+	std::uint64_t duplicates = 0;	// identical ticks from overlapping files
+	std::uint64_t late = 0;			// ticks behind the look-back, dropped
+};
+
+// Merges the hour files of one side into a single time-ordered stream.
+//
+// Files are merged through a min-heap on (epoch, file). Each file is keyed by
+// its first tick until the output reaches it and only then opened, so
+// disjoint hours keep one file open and the heap stays tiny. Ticks then pass
+// through a window held lookback_ms behind the newest tick, which puts small
+// disorder inside a file back in order. Ties keep the file order, so
+// same-millisecond ticks are not reshuffled.
+//
+// A tick equal in epoch, price and size to one already emitted from another
+// file is dropped as a duplicate. A tick older than the last emitted one is
+// dropped as late. Both are counted into stats when given; stats are plain
+// counters, so give every source that runs on its own thread its own.
+class MergingTickSource : public TickSource {
+public:
+	MergingTickSource(	const std::vector<std::string>& files,
+						const fs::path& dir,
+						std::int64_t lookback_ms,
+						MergeStats* stats = nullptr);
+
+	size_t
+	read(TickEntry* out, size_t capacity) override;
+
+private:
+	static constexpr size_t BLOCK = 256;
+
+	// ticks buf[pos, size) are read but not merged yet; buf[pos] is the head
+	struct Input {
+		std::string file;
+		std::unique_ptr<TickSource> source;
+		std::vector<TickEntry> buf;
+		size_t pos = 0;
+		size_t size = 0;
+	};
+
+	// until opened a file is keyed by its first tick
+	struct HeapEntry {
+		std::int64_t epoch;
+		std::uint32_t input;
+		bool opened;
+	};
+
+	struct Held {
+		TickEntry tick;
+		std::uint32_t input;
+	};
+
+	fs::path dir;
+	std::int64_t lookback;
+	MergeStats* stats;
+
+	std::vector<Input> inputs;
+	std::vector<HeapEntry> heap;
+
+	// sorted by epoch, stable; released from front, compacted now and then
+	std::vector<Held> window;
+	size_t window_front = 0;
+	std::int64_t newest = INT64_MIN;
+
+	bool drained = false;
+	bool has_emitted = false;
+	std::int64_t emitted_epoch = 0;
+	std::vector<Held> emitted_at_epoch;		// for duplicate checks
+	bool single_input = true;				// all of them from one file
+
+	// heap order: earliest epoch first, then file order
+	static bool
+	later(const HeapEntry& a, const HeapEntry& b);
+
+	// makes buf[pos] valid; false at the end of the file
+	bool
+	refill(Input& input);
+
+	// restores the heap after the top's key changed
+	void
+	sift_top();
+
+	// Moves the run of ticks of the heap's top file that sorts before every
+	// other file into the window; false once all files are drained.
+	bool
+	pull();
+
+	// true when the tick was emitted, false when it was a duplicate
+	bool
+	emit(const Held& held, TickEntry& out);
+};
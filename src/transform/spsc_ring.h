@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Lock-free single-producer/single-consumer ring. Each side keeps its index
+// on its own cache line together with a cached copy of the other side's
+// index, so the shared line is only read when the cache runs out. Batches
+// are published with a single release store.
+template <typename T, std::size_t Capacity>
+class SpscRing {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+	SpscRing(): slots(std::make_unique<T[]>(Capacity)) {}
+
+	SpscRing(const SpscRing&) = delete;
+
+	SpscRing&
+	operator=(const SpscRing&) = delete;
+
+	// producer side; returns how many items were taken
+	std::size_t
+	push(const T* items, std::size_t count) {
+		const auto tail = producer.index.load(std::memory_order_relaxed);
+
+		if (Capacity - (tail - producer.cached) < count) {
+			producer.cached = consumer.index.load(std::memory_order_acquire);
+		}
+
+		const auto n = std::min(count, Capacity - (tail - producer.cached));
+		for (std::size_t i = 0; i < n; ++i) slots[(tail + i) & mask] = items[i];
+
+		producer.index.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+	// consumer side; returns how many items were written to out
+	std::size_t
+	pop(T* out, std::size_t capacity) {
+		const auto head = consumer.index.load(std::memory_order_relaxed);
+
+		if (consumer.cached == head) {
+			consumer.cached = producer.index.load(std::memory_order_acquire);
+		}
+
+		const auto n = std::min(capacity, consumer.cached - head);
+		for (std::size_t i = 0; i < n; ++i) out[i] = slots[(head + i) & mask];
+
+		consumer.index.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	static constexpr std::size_t mask = Capacity - 1;
+	static constexpr std::size_t line = 64;
+
+	struct alignas(line) Side {
+		std::atomic<std::size_t> index{0};
+		std::size_t cached = 0;	// last seen index of the other side
+	};
+
+	Side producer;
+	Side consumer;
+
+	std::unique_ptr<T[]> slots;
+};
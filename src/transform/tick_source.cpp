@@ -0,0 +1,125 @@
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "tick_source.h"
+
+namespace {
+
+template<typename T>
+bool
+parse_field(const char*& pos, const char* end, T& out, bool last) {
+	auto [ptr, ec] = std::from_chars(pos, end, out);
+	if (ec != std::errc{}) return false;
+
+	if (last) return true;
+	if (ptr == end || *ptr != ',') return false;
+
+	pos = ptr + 1;
+	return true;
+}
+
+}
+
+bool
+parse_tick_line(std::string_view line, TickEntry& out) {
+	if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+	if (line.empty()) return false;
+
+	const char* pos = line.data();
+	const char* end = pos + line.size();
+
+	if (!parse_field(pos, end, out.epoch, false)
+		|| !parse_field(pos, end, out.price, false)
+		|| !parse_field(pos, end, out.size, true))
+	{
+		throw std::runtime_error("Failed to parse tick line: " + std::string(line));
+	}
+
+	return true;
+}
+
+bool
+get_tick_entry(MultiFileReader& in, TickEntry& out) {
+	std::string_view line;
+
+	if (!in.getline(line)) return false;
+	return parse_tick_line(line, out);
+}
+
+size_t
+FileTickSource::read(TickEntry* out, size_t capacity) {
+	size_t n = 0;
+
+	while (!exhausted && n < capacity) {
+		if (!get_tick_entry(reader, out[n])) {
+			exhausted = true;
+			break;
+		}
+		++n;
+	}
+
+	return n;
+}
+
+ThreadedTickSource::ThreadedTickSource(std::unique_ptr<TickSource> inner):
+	inner(std::move(inner))
+{
+	worker = std::thread([this] { produce(); });
+}
+
+ThreadedTickSource::~ThreadedTickSource() {
+	stopping = true;
+	worker.join();
+}
+
+void
+ThreadedTickSource::produce() {
+	std::vector<TickEntry> batch(BATCH);
+
+	try {
+		while (!stopping) {
+			auto n = inner->read(batch.data(), batch.size());
+			if (n == 0) break;
+
+			for (size_t pushed = 0; pushed < n && !stopping;) {
+				auto got = ring.push(batch.data() + pushed, n - pushed);
+				if (got == 0) std::this_thread::yield();
+				pushed += got;
+			}
+		}
+	} catch (...) {
+		error = std::current_exception();
+	}
+
+	done.store(true, std::memory_order_release);
+}
+
+size_t
+ThreadedTickSource::read(TickEntry* out, size_t capacity) {
+	while (true) {
+		if (auto n = ring.pop(out, capacity)) return n;
+
+		if (done.load(std::memory_order_acquire)) {
+			// the producer may have published between the pop and the flag
+			if (auto n = ring.pop(out, capacity)) return n;
+			if (error) std::rethrow_exception(error);
+			return 0;
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+std::unique_ptr<TickSource>
+make_tick_source(std::unique_ptr<TickSource> source, bool threaded) {
+	if (!threaded) return source;
+
+	return std::make_unique<ThreadedTickSource>(std::move(source));
+}
+
+std::unique_ptr<TickSource>
+make_tick_source(MultiFileReader&& reader, bool threaded) {
+	return make_tick_source(std::make_unique<FileTickSource>(std::move(reader)), threaded);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../organizer/organizer.h"
+#include "./spsc_ring.h"
+
+struct TickEntry {
+	std::int64_t epoch;
+
+	double price;
+	double size;
+};
+
+// epoch,price,size; false for an empty line, throws on a malformed one
+bool
+parse_tick_line(std::string_view line, TickEntry& out);
+
+bool
+get_tick_entry(MultiFileReader& in, TickEntry& out);
+
+// Producer of parsed ticks, handed out in blocks so the virtual call is
+// paid once per block rather than per tick.
+class TickSource {
+public:
+	virtual ~TickSource() = default;
+
+	// fills up to capacity ticks; 0 means the stream is exhausted
+	virtual size_t
+	read(TickEntry* out, size_t capacity) = 0;
+};
+
+// Parses the reader's lines on the calling thread.
+class FileTickSource : public TickSource {
+public:
+	explicit
+	FileTickSource(MultiFileReader&& reader): reader(std::move(reader)) {}
+
+	size_t
+	read(TickEntry* out, size_t capacity) override;
+
+private:
+	MultiFileReader reader;
+	bool exhausted = false;
+};
+
+// Runs another source on a background thread and hands its ticks over
+// through an SPSC ring. Errors from the producer are rethrown by read().
+class ThreadedTickSource : public TickSource {
+public:
+	explicit
+	ThreadedTickSource(std::unique_ptr<TickSource> inner);
+
+	ThreadedTickSource(const ThreadedTickSource&) = delete;
+
+	ThreadedTickSource&
+	operator=(const ThreadedTickSource&) = delete;
+
+	~ThreadedTickSource() override;
+
+	size_t
+	read(TickEntry* out, size_t capacity) override;
+
+private:
+	static constexpr size_t RING_SIZE = 1 << 16;
+	static constexpr size_t BATCH = 1024;
+
+	std::unique_ptr<TickSource> inner;
+	SpscRing<TickEntry, RING_SIZE> ring;
+
+	std::atomic<bool> done = false;
+	std::atomic<bool> stopping = false;
+	std::exception_ptr error;
+
+	std::thread worker;
+
+	void
+	produce();
+};
+
+std::unique_ptr<TickSource>
+make_tick_source(std::unique_ptr<TickSource> source, bool threaded);
+
+std::unique_ptr<TickSource>
+make_tick_source(MultiFileReader&& reader, bool threaded);
+
+// Per-tick view over a TickSource.
+class TickStream {
+public:
+	explicit
+	TickStream(std::unique_ptr<TickSource> source):
+		source(std::move(source)), buf(BLOCK) {}
+
+	bool
+	next(TickEntry& out) {
+		if (pos == size) {
+			size = source->read(buf.data(), buf.size());
+			pos = 0;
+			if (size == 0) return false;
+		}
+
+		out = buf[pos++];
+		return true;
+	}
+
+private:
+	static constexpr size_t BLOCK = 1024;
+
+	std::unique_ptr<TickSource> source;
+	std::vector<TickEntry> buf;
+	size_t pos = 0;
+	size_t size = 0;
+};
@@ -1,28 +1,17 @@
+#include <algorithm>
 #include <cmath>
 
 #include "transform.h"
 
-bool
-get_tick_entry(MultiFileReader& in, TickEntry& out) {
-	std::string line;
-
-	if (!in.getline(line)) return false;
-	if (line.empty()) return false;
-
-	std::istringstream iss(line);
-	char comma;
-	iss >> out.epoch >> comma >> out.price >> comma >> out.size;
-
-	if (!iss) {
-		throw std::runtime_error("Failed to parse tick line: " + line);
-	}
-
-	return true;
-}
-
 bool
 AskBidMerger::get_next_mid_tick(TickEntry& out) {
 	while (true) {
+		if (live) {
+			if (!has_curr_ask) has_curr_ask = ask_stream.next(curr_ask);
+			if (!has_curr_bid) has_curr_bid = bid_stream.next(curr_bid);
+			if (!has_curr_ask || !has_curr_bid) return false;
+		}
+
 		if (!has_curr_ask && !has_curr_bid) return false;
 		bool use_bid;
 
@@ -38,13 +27,13 @@ AskBidMerger::get_next_mid_tick(TickEntry& out) {
 			has_last_bid = true;
 
 			epoch = last_bid.epoch;
-			has_curr_bid = get_tick_entry(bid_stream, curr_bid);
+			has_curr_bid = bid_stream.next(curr_bid);
 		} else {
 			last_ask = curr_ask;
 			has_last_ask = true;
 
 			epoch = last_ask.epoch;
-			has_curr_ask = get_tick_entry(ask_stream, curr_ask);
+			has_curr_ask = ask_stream.next(curr_ask);
 		}
 
 		if (last_epoch != -1 && epoch - last_epoch > GAP_RESET) {
@@ -64,58 +53,44 @@ AskBidMerger::get_next_mid_tick(TickEntry& out) {
 	return false;
 }
 
-// nodejs debug check
-// require('fs').readFileSync(filePath, 'utf8').split('\n').map(s => s.split(',').map(r => Number(r))).filter(k => k.length >= 5).every(([x, o, h, l, c]) => h >= o && h >= c && l <= o && l <= c)
-
 bool
 AskBidMerger::get_next_candle(Candle& out) {
 	TickEntry tick{};
 
-	if (has_buffered) {
-
-		tick = buffered;
-		has_buffered = false;
-
-	} else if (!get_next_mid_tick(tick)) {
-		return false;
-	}
+	while (get_next_mid_tick(tick)) {
+		auto open_time = tick.epoch / frame * frame;
 
-	auto bucket = tick.epoch / frame;
-	auto open_time = bucket * frame;
+		if (has_open && open_time == open.time) {
+			open.high = std::max(open.high, tick.price);
+			open.low  = std::min(open.low, tick.price);
 
-	Candle candle {
-		.open  = tick.price,
-		.close = tick.price,
-		.high  = tick.price,
-		.low   = tick.price,
-		
-		.time = open_time,
-		.tick_count = 1,
-	};
-
-	while (true) {
-		TickEntry tick{};
-		if (!get_next_mid_tick(tick)) {
-			out = candle;
-			return true;
+			open.close = tick.price;
+			++open.tick_count;
+			continue;
 		}
 
-		auto curr_bucket = tick.epoch / frame;
-		if (curr_bucket != bucket) {
+		const bool closed = has_open;
+		if (closed) out = open;
 
-			buffered = tick;
-			has_buffered = true;
-			break;
-		}
+		open = Candle {
+			.time = open_time,
+			.tick_count = 1,
 
-		candle.high = std::max(candle.high, tick.price);
-		candle.low  = std::min(candle.low, tick.price);
+			.open  = tick.price,
+			.high  = tick.price,
+			.low   = tick.price,
+			.close = tick.price,
+		};
+		has_open = true;
 
-		candle.close = tick.price;
-		++candle.tick_count;
+		if (closed) return true;
 	}
 
-	out = candle;
+	// out of ticks; a live source may still extend the open candle
+	if (!has_open || live) return false;
+
+	out = open;
+	has_open = false;
 	return true;
 }
 
@@ -9,6 +9,7 @@
 #include <string>
 
 #include "../organizer/organizer.h"
+#include "./tick_source.h"
 
 namespace fs = std::filesystem;
 
@@ -22,33 +23,50 @@ struct Candle {
 	double close;
 };
 
-struct TickEntry {
-	std::int64_t epoch;
-
-	double price;
-	double size;
-};
-
-bool
-get_tick_entry(MultiFileReader& in, TickEntry& out);
-
 class AskBidMerger {
 public:
 	AskBidMerger() = delete;
 	AskBidMerger(MultiFileReader&& ask_stream, MultiFileReader&& bid_stream, std::int64_t frame):
-		ask_stream(std::move(ask_stream)), bid_stream(std::move(bid_stream)), frame(frame)
+		AskBidMerger(
+			std::make_unique<FileTickSource>(std::move(ask_stream)),
+			std::make_unique<FileTickSource>(std::move(bid_stream)),
+			frame
+		) {}
+
+	AskBidMerger(std::unique_ptr<TickSource> ask_source, std::unique_ptr<TickSource> bid_source, std::int64_t frame):
+		ask_stream(std::move(ask_source)), bid_stream(std::move(bid_source)), frame(frame)
 	{
 		init();
 	}
 
+	// Closed candles in time order. Once the sources are exhausted the last,
+	// still open candle is returned too, except in live mode.
 	bool
 	get_next_candle(Candle& out);
 
+	// Live mode treats an empty read as "no tick yet" rather than the end of
+	// a side, so nothing is merged past the side that is behind and the open
+	// candle stays open. Calls that return false can be retried once the
+	// sources have grown.
+	void
+	set_live(bool enable) { live = enable; }
+
+	// the candle being built, if any
+	const Candle*
+	open_candle() const { return has_open ? &open : nullptr; }
+
+	bool
+	get_next_mid_tick(TickEntry& out);
+
+	// ask - bid behind the last mid tick
+	double
+	spread() const { return last_ask.price - last_bid.price; }
+
 private:
 	static constexpr std::int64_t GAP_RESET = 1000 * 60; // reset on 1m gaps
 
-	MultiFileReader ask_stream;
-	MultiFileReader bid_stream;
+	TickStream ask_stream;
+	TickStream bid_stream;
 
 	std::int64_t frame;
 
@@ -64,18 +82,17 @@ private:
 	bool has_last_bid = false;
 	TickEntry last_bid{};
 
-	bool has_buffered = false;
-	TickEntry buffered{};
+	bool has_open = false;
+	Candle open{};
+
+	bool live = false;
 
 	void
 	init() {
-		has_curr_ask = get_tick_entry(ask_stream, curr_ask);
-		has_curr_bid = get_tick_entry(bid_stream, curr_bid);
+		has_curr_ask = ask_stream.next(curr_ask);
+		has_curr_bid = bid_stream.next(curr_bid);
 	}
 
-	bool
-	get_next_mid_tick(TickEntry& out);
-
 	std::int64_t
 	get_last_epoch() const;
 };
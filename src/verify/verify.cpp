@@ -0,0 +1,256 @@
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "duckdb.hpp"
+
+#include "verify.h"
+#include "../memory/buffer_pool.h"
+#include "../writer/writer.h"
+
+namespace {
+
+// a check holds for a row when ok evaluates to true; NULL counts as failed
+struct Check {
+	const char* name;
+	std::string ok;
+};
+
+std::unique_ptr<duckdb::MaterializedQueryResult>
+query(duckdb::Connection& connection, const std::string& sql) {
+	auto res = connection.Query(sql);
+	if (res->HasError()) {
+		throw std::runtime_error("Verify query failed: " + sql + ": " + res->GetError());
+	}
+	return res;
+}
+
+std::int64_t
+int_at(const duckdb::MaterializedQueryResult& res, std::size_t col) {
+	auto value = res.GetValue(col, 0);
+	return value.IsNull() ? -1 : value.GetValue<std::int64_t>();
+}
+
+// reads (count, first time) column pairs starting at col
+void
+collect(const duckdb::MaterializedQueryResult& res,
+		std::size_t col,
+		const std::vector<const char*>& names,
+		VerifyReport& report)
+{
+	for (auto* name : names) {
+		report.checks.push_back(CheckResult {
+			.name = name,
+			.violations = static_cast<std::uint64_t>(int_at(res, col)),
+			.first_time = int_at(res, col + 1),
+		});
+		col += 2;
+	}
+}
+
+// all row-local checks in one vectorized scan
+void
+run_row_checks(	duckdb::Connection& connection,
+				const std::string& source,
+				std::int64_t frame,
+				VerifyReport& report)
+{
+	const std::vector<Check> checks {
+		{ "finite_prices",  "isfinite(open) AND isfinite(high) AND isfinite(low) AND isfinite(close)" },
+		{ "ohlc_bounds",    "high >= greatest(open, close) AND low <= least(open, close)" },
+		{ "frame_aligned",  "time % " + std::to_string(frame) + " = 0" },
+		{ "tick_count",     "volume > 0" },
+	};
+
+	std::string sql = "SELECT count(*)";
+	std::vector<const char*> names{};
+
+	for (const auto& check : checks) {
+		const auto bad = "(" + check.ok + ") IS NOT TRUE";
+		sql += ", count(*) FILTER (WHERE " + bad + "), min(time) FILTER (WHERE " + bad + ")";
+		names.push_back(check.name);
+	}
+	sql += " FROM " + source;
+
+	auto res = query(connection, sql);
+	report.rows = static_cast<std::uint64_t>(int_at(*res, 0));
+	collect(*res, 1, names, report);
+}
+
+void
+run_order_checks(	duckdb::Connection& connection,
+					const std::string& source,
+					bool per_file_order,
+					VerifyReport& report)
+{
+	auto dup = query(connection,
+		"SELECT count(*), min(time) FROM ("
+		"	SELECT time FROM " + source + " GROUP BY time HAVING count(*) > 1"
+		")"
+	);
+	collect(*dup, 0, { "unique_time" }, report);
+
+	// tables are upserted day by day (and shard by shard), so only files
+	// have a storage order worth checking
+	if (!per_file_order) return;
+
+	auto order = query(connection,
+		"SELECT count(*) FILTER (WHERE time <= prev), min(time) FILTER (WHERE time <= prev) FROM ("
+		"	SELECT time, lag(time) OVER (PARTITION BY filename ORDER BY file_row_number) AS prev"
+		"	FROM " + source +
+		")"
+	);
+	collect(*order, 0, { "ascending_time" }, report);
+}
+
+std::vector<const DayJob*>
+pick_days(const BatchPlan& plan, const std::string& symbol, std::size_t count) {
+	std::vector<const DayJob*> days{};
+	for (const auto& day : plan.days) {
+		if (day.symbol == symbol && day.complete()) days.push_back(&day);
+	}
+
+	if (count == 0 || days.empty()) return {};
+	if (count >= days.size()) return days;
+
+	// evenly spread, always ending on the latest day
+	std::vector<const DayJob*> picked{};
+	for (std::size_t i = 0; i < count; ++i) {
+		const auto at = count == 1 ? days.size() - 1 : i * (days.size() - 1) / (count - 1);
+		picked.push_back(days[at]);
+	}
+
+	return picked;
+}
+
+void
+run_sample_checks(	duckdb::Connection& connection,
+					const std::string& source,
+					const Settings& settings,
+					std::size_t sample_days,
+					spdlog::logger& logger,
+					VerifyReport& report)
+{
+	// whole days, as write_stage aggregates them
+	const auto plan = plan_batches(settings.unzipped_dir, settings.range.whole_days());
+	const auto days = pick_days(plan, settings.symbol, sample_days);
+
+	if (days.empty()) {
+		logger.warn("No decompressed days of {} to re-aggregate", settings.symbol);
+		return;
+	}
+
+	query(connection,
+		"CREATE TABLE verify_sample ("
+		"	time BIGINT, open DOUBLE, high DOUBLE, low DOUBLE, close DOUBLE, volume BIGINT"
+		")"
+	);
+	query(connection, "CREATE TABLE verify_days (lo BIGINT, hi BIGINT)");
+
+	{
+		duckdb::Appender sample(connection, "verify_sample");
+		duckdb::Appender ranges(connection, "verify_days");
+
+		BatchArena arena{};
+
+		for (const auto* day : days) {
+			arena.reset();
+			std::pmr::vector<Candle> candles{&arena};
+
+			aggregate_day(settings, *day, candles);
+			if (candles.empty()) continue;
+
+			for (const auto& candle : candles) {
+				sample.BeginRow();
+				sample.Append(candle.time);
+				sample.Append(candle.open);
+				sample.Append(candle.high);
+				sample.Append(candle.low);
+				sample.Append(candle.close);
+				sample.Append(candle.tick_count);
+				sample.EndRow();
+			}
+
+			ranges.BeginRow();
+			ranges.Append(candles.front().time);
+			ranges.Append(candles.back().time);
+			ranges.EndRow();
+
+			logger.info("Re-aggregated {} {}: {} candles", day->symbol, day->key, candles.size());
+			++report.sampled_days;
+		}
+
+		sample.Close();
+		ranges.Close();
+	}
+
+	const std::string missing = "stored.time IS NULL OR fresh.time IS NULL";
+	const std::string volume  = "stored.volume <> fresh.volume";
+	const std::string prices  =
+		"stored.open <> fresh.open OR stored.high <> fresh.high"
+		" OR stored.low <> fresh.low OR stored.close <> fresh.close";
+
+	auto pair = [](const std::string& bad) {
+		return "count(*) FILTER (WHERE " + bad + "), "
+			"min(coalesce(fresh.time, stored.time)) FILTER (WHERE " + bad + ")";
+	};
+
+	auto res = query(connection,
+		"WITH stored AS ("
+		"	SELECT s.time, s.open, s.high, s.low, s.close, s.volume"
+		"	FROM " + source + " s JOIN verify_days d ON s.time BETWEEN d.lo AND d.hi"
+		") "
+		"SELECT " + pair(missing) + ", " + pair(volume) + ", " + pair(prices) + " "
+		"FROM verify_sample fresh FULL OUTER JOIN stored ON stored.time = fresh.time"
+	);
+	collect(*res, 0, { "resampled_rows", "resampled_tick_count", "resampled_ohlc" }, report);
+}
+
+}
+
+bool
+VerifyReport::ok() const {
+	for (const auto& check : checks) {
+		if (check.violations) return false;
+	}
+	return true;
+}
+
+VerifyReport
+verify_candles(	const Settings& settings,
+				const std::string& parquet,
+				std::size_t sample_days,
+				spdlog::logger& logger)
+{
+	// in-memory database for the sample tables; the source is only read
+	duckdb::DuckDB db(nullptr);
+	duckdb::Connection connection(db);
+
+	std::string source{};
+	if (parquet.empty()) {
+		query(connection, "ATTACH " + quote_literal(settings.db_path.string()) + " AS stored_db (READ_ONLY)");
+		source = "stored_db.candles_" + settings.symbol;
+	} else {
+		source = "read_parquet(" + quote_literal(parquet) + ", filename = true, file_row_number = true)";
+	}
+
+	logger.info("Verifying {} (frame={}ms)", source, settings.frame);
+
+	VerifyReport report{};
+	run_row_checks(connection, source, settings.frame, report);
+	run_order_checks(connection, source, !parquet.empty(), report);
+	run_sample_checks(connection, source, settings, sample_days, logger, report);
+
+	for (const auto& check : report.checks) {
+		if (check.violations) {
+			logger.error("{}: {} violation(s), first at time={}", check.name, check.violations, check.first_time);
+		} else {
+			logger.info("{}: ok", check.name);
+		}
+	}
+
+	logger.info("Verified {} rows, {} sampled day(s)", report.rows, report.sampled_days);
+	return report;
+}
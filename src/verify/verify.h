@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "../pipeline/pipeline.h"
+
+struct CheckResult {
+	std::string name;
+	std::uint64_t violations = 0;
+	std::int64_t first_time = -1;		// earliest offending candle, -1 if none
+};
+
+struct VerifyReport {
+	std::uint64_t rows = 0;
+	std::size_t sampled_days = 0;
+	std::vector<CheckResult> checks;
+
+	bool
+	ok() const;
+};
+
+// Scans stored candles with set-based DuckDB queries:
+//  - finite prices and high/low bounding open/close
+//  - no duplicated time, and per file ascending time for Parquet
+//  - time aligned to settings.frame, tick_count positive
+//  - sample_days complete days in settings.range (spread out, latest included)
+//    re-aggregated from DECOMPRESSED_FOLDER and compared row by row
+// The source is candles_<symbol> in settings.db_path, or a Parquet file or
+// glob when parquet is not empty.
+VerifyReport
+verify_candles(	const Settings& settings,
+				const std::string& parquet,
+				std::size_t sample_days,
+				spdlog::logger& logger);
@@ -1,5 +1,8 @@
-#include <vector>
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <memory>
+#include <vector>
 
 #include "duckdb.hpp"
 
@@ -7,11 +10,18 @@
 
 namespace {
 
+std::int64_t
+now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+}
+
 void
-create_candles_table(const std::string& name, duckdb::Connection& connection) {
+create_candles_table(const std::string& name, duckdb::Connection& connection, bool keyed = true) {
 	const auto query =
 		"CREATE TABLE IF NOT EXISTS " + name + " ("
-		"	time   BIGINT PRIMARY KEY,"
+		"	time   BIGINT" + (keyed ? " PRIMARY KEY," : ",") +
 		"	open   DOUBLE,"
 		"	high   DOUBLE,"
 		"	low    DOUBLE,"
@@ -27,21 +37,225 @@ create_candles_table(const std::string& name, duckdb::Connection& connection) {
 	}
 }
 
+void
+upsert_candles(	const std::string& table_name,
+				const std::string& source,
+				duckdb::Connection& connection)
+{
+	const auto merge_query =
+		"INSERT INTO " + table_name +
+		"	(time, open, high, low, close, volume) "
+		"SELECT time, open, high, low, close, volume "
+		"FROM " + source + " "
+		"ON CONFLICT (time) DO UPDATE SET "
+		"  open   = EXCLUDED.open,"
+		"  high   = EXCLUDED.high,"
+		"  low    = EXCLUDED.low,"
+		"  close  = EXCLUDED.close,"
+		"  volume = EXCLUDED.volume";
+
+	auto merge_res = connection.Query(merge_query);
+	if (merge_res->HasError()) {
+		auto msg = "Failed to merge " + source + " into "
+			+ table_name
+			+ ": "
+			+ merge_res->GetError();
+		throw std::runtime_error(msg);
+	}
 }
 
 void
-write_candles_to_db(const std::vector<Candle>& candles,
-					const fs::path& db_path,
-					const std::string& symbol)
+run_query(const std::string& query, duckdb::Connection& connection) {
+	auto res = connection.Query(query);
+	if (res->HasError()) {
+		throw std::runtime_error("Query failed: " + query + ": " + res->GetError());
+	}
+}
+
+std::vector<std::string>
+query_column(const std::string& query, duckdb::Connection& connection) {
+	auto res = connection.Query(query);
+	if (res->HasError()) {
+		throw std::runtime_error("Query failed: " + query + ": " + res->GetError());
+	}
+
+	std::vector<std::string> out{};
+	for (std::size_t row = 0; row < res->RowCount(); ++row) {
+		out.push_back(res->GetValue(0, row).ToString());
+	}
+	return out;
+}
+
+// Append mode keeps candles_<symbol>_<yyyymm> tables without an index, every
+// row tagged with the generation of the load that wrote it.
+// candles_<symbol>_partitions lists the months and flags the ones written
+// since their last compaction, and candles_<symbol> becomes a view with the
+// latest generation of every time. A time only ever lands in the partition of
+// its month, so generations are picked per partition, and only in the dirty
+// ones: a compacted partition holds one row per time already.
+
+constexpr auto MONTH_OF_TIME = "strftime(epoch_ms(time), '%Y%m')";
+constexpr auto LATEST_GENERATION = "QUALIFY row_number() OVER (PARTITION BY time ORDER BY generation DESC) = 1";
+
+// "BASE TABLE", "VIEW" or empty when name does not exist
+std::string
+object_type(const std::string& name, duckdb::Connection& connection) {
+	const auto types = query_column(
+		"SELECT table_type FROM information_schema.tables "
+		"WHERE table_catalog = current_database() AND table_schema = current_schema() "
+		"AND table_name = " + quote_literal(name),
+		connection
+	);
+	return types.empty() ? "" : types.front();
+}
+
+void
+create_partition_catalog(const std::string& base, duckdb::Connection& connection) {
+	run_query(
+		"CREATE TABLE IF NOT EXISTS " + base + "_partitions ("
+		"	month VARCHAR PRIMARY KEY,"
+		"	dirty BOOLEAN"
+		")",
+		connection
+	);
+}
+
+void
+create_partition(const std::string& name, duckdb::Connection& connection) {
+	run_query(
+		"CREATE TABLE IF NOT EXISTS " + name + " ("
+		"	time       BIGINT,"
+		"	open       DOUBLE,"
+		"	high       DOUBLE,"
+		"	low        DOUBLE,"
+		"	close      DOUBLE,"
+		"	volume     BIGINT,"
+		"	generation BIGINT"
+		")",
+		connection
+	);
+}
+
+void
+refresh_view(const std::string& base, duckdb::Connection& connection) {
+	auto res = connection.Query("SELECT month, dirty FROM " + base + "_partitions ORDER BY month");
+	if (res->HasError()) {
+		throw std::runtime_error("Failed to list partitions of " + base + ": " + res->GetError());
+	}
+	if (res->RowCount() == 0) return;
+
+	std::string partitions{};
+	for (std::size_t row = 0; row < res->RowCount(); ++row) {
+		const auto month = res->GetValue(0, row).ToString();
+		const auto dirty = res->GetValue(1, row).GetValue<bool>();
+
+		if (!partitions.empty()) partitions += " UNION ALL ";
+		partitions += "SELECT time, open, high, low, close, volume FROM " + base + "_" + month;
+		if (dirty) partitions += std::string(" ") + LATEST_GENERATION;
+	}
+
+	run_query("CREATE OR REPLACE VIEW " + base + " AS " + partitions, connection);
+}
+
+// Appends the rows of source to their month partitions; generation is an
+// SQL expression, a literal for new loads or the column when merging shards.
+void
+append_partitions(	const std::string& base,
+					const std::string& source,
+					const std::string& generation,
+					duckdb::Connection& connection)
 {
-	duckdb::DuckDB db(db_path);
-	duckdb::Connection connection(db);
+	const auto months = query_column(
+		std::string("SELECT DISTINCT ") + MONTH_OF_TIME + " FROM " + source,
+		connection
+	);
+
+	for (const auto& month : months) {
+		const auto partition = base + "_" + month;
+		create_partition(partition, connection);
+
+		run_query(
+			"INSERT INTO " + partition + " "
+			"SELECT time, open, high, low, close, volume, " + generation + " "
+			"FROM " + source + " WHERE " + MONTH_OF_TIME + " = " + quote_literal(month),
+			connection
+		);
+		run_query(
+			"INSERT INTO " + base + "_partitions VALUES (" + quote_literal(month) + ", true) "
+			"ON CONFLICT (month) DO UPDATE SET dirty = true",
+			connection
+		);
+	}
+
+	if (!months.empty()) refresh_view(base, connection);
+}
+
+// Creates what mode needs for candles_<symbol> named base. A table left by
+// upsert mode is moved into month partitions under generation 0, so any later
+// load wins over it; a view left by append mode cannot take upserts.
+void
+prepare_candles(const std::string& base, StorageMode mode, duckdb::Connection& connection) {
+	const auto type = object_type(base, connection);
+
+	if (mode == StorageMode::Upsert) {
+		if (type == "VIEW") {
+			throw std::runtime_error(
+				base + " was written in append mode (a view over month partitions); "
+				"set STORAGE_MODE=append to keep loading it"
+			);
+		}
+		create_candles_table(base, connection);
+		return;
+	}
+
+	create_partition_catalog(base, connection);
+	if (type != "BASE TABLE") return;
+
+	const auto legacy = base + "_upsert";
+	try {
+		run_query("BEGIN TRANSACTION", connection);
+		run_query("ALTER TABLE " + base + " RENAME TO " + legacy, connection);
+		append_partitions(base, legacy, "0", connection);
+		run_query("DROP TABLE " + legacy, connection);
+		run_query("COMMIT", connection);
+	} catch (...) {
+		connection.Query("ROLLBACK");
+		throw;
+	}
+}
+
+}
+
+std::string
+quote_literal(const std::string& s) {
+	std::string out = "'";
+	for (char c : s) {
+		if (c == '\'') out += '\'';
+		out += c;
+	}
+	return out + "'";
+}
 
-	const auto table_name   = "candles_" + symbol;
-	const auto staging_name = table_name + "_staging";
+struct CandleWriter::State {
+	duckdb::DuckDB db;
+	duckdb::Connection connection;
+	std::unique_ptr<duckdb::Appender> staging;
 
-	create_candles_table(table_name, connection);
+	explicit
+	State(const fs::path& db_path): db(db_path), connection(db) {}
+};
 
+CandleWriter::CandleWriter(const fs::path& db_path, const std::string& symbol, StorageMode mode):
+	state(std::make_unique<State>(db_path)),
+	table_name("candles_" + symbol),
+	staging_name(table_name + "_staging"),
+	mode(mode),
+	generation(now_us())
+{
+	auto& connection = state->connection;
+	prepare_candles(table_name, mode, connection);
+
+	// rows left behind by a run that died before committing
 	auto drop_res = connection.Query("DROP TABLE IF EXISTS " + staging_name);
 	if (drop_res->HasError()) {
 		auto msg = "Failed to drop staging table "
@@ -51,41 +265,149 @@ write_candles_to_db(const std::vector<Candle>& candles,
 		throw std::runtime_error(msg);
 	}
 
-	create_candles_table(staging_name, connection);
+	create_candles_table(staging_name, connection, mode == StorageMode::Upsert);
+	state->staging = std::make_unique<duckdb::Appender>(connection, staging_name);
+}
 
-	{
-		duckdb::Appender bulk_data(connection, staging_name);
-		for (const auto& candle : candles) {
-			bulk_data.BeginRow();
-			bulk_data.Append(candle.time);
-			bulk_data.Append(candle.open);
-			bulk_data.Append(candle.high);
-			bulk_data.Append(candle.low);
-			bulk_data.Append(candle.close);
-			bulk_data.Append(candle.tick_count);
-			bulk_data.EndRow();
+CandleWriter::~CandleWriter() = default;
+
+void
+CandleWriter::append(std::span<const Candle> candles) {
+	auto& bulk_data = *state->staging;
+
+	for (const auto& candle : candles) {
+		bulk_data.BeginRow();
+		bulk_data.Append(candle.time);
+		bulk_data.Append(candle.open);
+		bulk_data.Append(candle.high);
+		bulk_data.Append(candle.low);
+		bulk_data.Append(candle.close);
+		bulk_data.Append(candle.tick_count);
+		bulk_data.EndRow();
+	}
+
+	pending += candles.size();
+}
+
+void
+CandleWriter::commit() {
+	if (pending == 0) return;
+
+	auto& connection = state->connection;
+
+	try {
+		state->staging->Close();
+
+		run_query("BEGIN TRANSACTION", connection);
+		if (mode == StorageMode::Append) {
+			// every commit is a newer load, also within one second of follow mode
+			generation = std::max(now_us(), generation + 1);
+			append_partitions(table_name, staging_name, std::to_string(generation), connection);
+		} else {
+			upsert_candles(table_name, staging_name, connection);
 		}
-		bulk_data.Close();
+		run_query("DELETE FROM " + staging_name, connection);
+		run_query("COMMIT", connection);
+	} catch (...) {
+		connection.Query("ROLLBACK");
+
+		// the batch is dropped and the writer left ready for the next one
+		connection.Query("DELETE FROM " + staging_name);
+		state->staging = std::make_unique<duckdb::Appender>(connection, staging_name);
+		pending = 0;
+		throw;
 	}
 
-	const auto merge_query =
-		"INSERT INTO " + table_name +
-		"	(time, open, high, low, close, volume) "
-		"SELECT time, open, high, low, close, volume "
-		"FROM " + staging_name + " "
-		"ON CONFLICT (time) DO UPDATE SET "
-		"  open   = EXCLUDED.open,"
-		"  high   = EXCLUDED.high,"
-		"  low    = EXCLUDED.low,"
-		"  close  = EXCLUDED.close,"
-		"  volume = EXCLUDED.volume";
+	state->staging = std::make_unique<duckdb::Appender>(connection, staging_name);
+	pending = 0;
+}
 
-	auto merge_res = connection.Query(merge_query);
-	if (merge_res->HasError()) {
-		auto msg = "Failed to merge staging into "
-			+ table_name
-			+ ": "
-			+ merge_res->GetError();
-		throw std::runtime_error(msg);
+void
+merge_dbs_into(	const std::vector<fs::path>& source_paths,
+				const fs::path& db_path,
+				const std::string& symbol,
+				StorageMode mode)
+{
+	if (source_paths.empty()) return;
+
+	duckdb::DuckDB db(db_path);
+	duckdb::Connection connection(db);
+
+	const auto table_name = "candles_" + symbol;
+	prepare_candles(table_name, mode, connection);
+
+	std::vector<std::string> attached{};
+	auto detach_all = [&]() {
+		for (const auto& name : attached) connection.Query("DETACH " + name);
+	};
+
+	try {
+		for (const auto& path : source_paths) {
+			const auto name = "shard_" + std::to_string(attached.size());
+			run_query("ATTACH " + quote_literal(path.string()) + " AS " + name + " (READ_ONLY)", connection);
+			attached.push_back(name);
+		}
+
+		run_query("BEGIN TRANSACTION", connection);
+
+		for (const auto& shard : attached) {
+			if (mode == StorageMode::Append) {
+				// the shard's generations are kept, they order loads across processes
+				const auto months = query_column("SELECT month FROM " + shard + "." + table_name + "_partitions", connection);
+				for (const auto& month : months) {
+					append_partitions(table_name, shard + "." + table_name + "_" + month, "generation", connection);
+				}
+			} else {
+				upsert_candles(table_name, shard + "." + table_name, connection);
+			}
+		}
+
+		run_query("COMMIT", connection);
+	} catch (...) {
+		connection.Query("ROLLBACK");
+		detach_all();
+		throw;
 	}
-}
\ No newline at end of file
+
+	detach_all();
+}
+
+std::vector<std::string>
+compact_candles(const fs::path& db_path, const std::string& symbol) {
+	duckdb::DuckDB db(db_path);
+	duckdb::Connection connection(db);
+
+	const auto base = "candles_" + symbol;
+	prepare_candles(base, StorageMode::Append, connection);
+
+	const auto months = query_column(
+		"SELECT month FROM " + base + "_partitions WHERE dirty ORDER BY month",
+		connection
+	);
+
+	for (const auto& month : months) {
+		const auto partition = base + "_" + month;
+		const auto compacted = partition + "_compacted";
+
+		// rewritten rather than deleted from, so the partition ends up
+		// sorted and without dead rows
+		try {
+			run_query("BEGIN TRANSACTION", connection);
+			run_query(
+				"CREATE TABLE " + compacted + " AS "
+				"SELECT * FROM " + partition + " " + LATEST_GENERATION + " ORDER BY time",
+				connection
+			);
+			run_query("DROP TABLE " + partition, connection);
+			run_query("ALTER TABLE " + compacted + " RENAME TO " + partition, connection);
+			run_query("UPDATE " + base + "_partitions SET dirty = false WHERE month = " + quote_literal(month), connection);
+			refresh_view(base, connection);
+			run_query("COMMIT", connection);
+		} catch (...) {
+			connection.Query("ROLLBACK");
+			throw;
+		}
+	}
+
+	return months;
+}
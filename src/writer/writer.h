@@ -1,9 +1,69 @@
-#include <vector>
+#pragma once
+
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
 
 #include "../transform/transform.h"
 
+// SQL string literal, e.g. for paths passed to ATTACH or read_parquet
+std::string
+quote_literal(const std::string& s);
+
+enum class StorageMode {
+	Upsert,		// candles_<symbol> keyed by time, merged with ON CONFLICT
+	Append,		// month partitions without an index plus compaction, see writer.cpp
+};
+
+// Collects candles in a staging table of db_path and upserts everything
+// appended since the previous commit() into candles_<symbol> in one
+// transaction, so readers see all of it or none of it. In append mode the
+// commit adds the rows to their month partitions under a generation newer
+// than any earlier commit of this writer instead. A commit that throws drops
+// what was appended since the previous one; the writer stays usable.
+//
+// An upsert mode table found in append mode is moved into partitions; an
+// append mode view found in upsert mode is an error.
+class CandleWriter {
+public:
+	CandleWriter(const fs::path& db_path, const std::string& symbol, StorageMode mode);
+
+	CandleWriter(const CandleWriter&) = delete;
+
+	CandleWriter&
+	operator=(const CandleWriter&) = delete;
+
+	~CandleWriter();
+
+	void
+	append(std::span<const Candle> candles);
+
+	void
+	commit();
+
+private:
+	struct State;
+
+	std::unique_ptr<State> state;
+	std::string table_name;
+	std::string staging_name;
+	StorageMode mode;
+	std::int64_t generation;	// microseconds since epoch of the last commit
+	std::size_t pending = 0;
+};
+
+// Upserts the candles tables of other database files, e.g. the shards
+// written by worker processes, into db_path all in one transaction.
 void
-write_candles_to_db(const std::vector<Candle>& candles,
-					const fs::path& db_path,
-					const std::string& symbol);
\ No newline at end of file
+merge_dbs_into(	const std::vector<fs::path>& source_paths,
+				const fs::path& db_path,
+				const std::string& symbol,
+				StorageMode mode);
+
+// Append mode: rewrites every partition written since its last compaction
+// with only the latest generation of each time. Returns the compacted months.
+std::vector<std::string>
+compact_candles(const fs::path& db_path, const std::string& symbol);
\ No newline at end of file
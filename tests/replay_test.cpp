@@ -0,0 +1,164 @@
+// Replays tests/fixtures/replay, two hours of EURUSD (one of them compressed,
+// with a stale .log.gz copy of a bid hour next to its .log) plus one hour of
+// GBPUSD that must not leak in. Exits non-zero on any mismatch.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "planner/planner.h"
+#include "replay/replay.h"
+
+namespace {
+
+constexpr std::int64_t HOUR_0 = 1709510400000;	// 2024-03-04 00:00 UTC
+constexpr std::int64_t HOUR_1 = HOUR_0 + 60 * 60 * 1000;
+
+int failures = 0;
+
+void
+check(bool ok, const std::string& what) {
+	if (ok) return;
+
+	std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+	++failures;
+}
+
+std::vector<ReplayTick>
+replay_all(const fs::path& dir, const ReplayOptions& options) {
+	std::vector<ReplayTick> out{};
+
+	TickReplay replay{dir, "EURUSD", options};
+	for (const auto& tick : replay) out.push_back(tick);
+
+	return out;
+}
+
+void
+check_ticks(const std::vector<ReplayTick>& got, const std::vector<ReplayTick>& expected, const std::string& what) {
+	check(got.size() == expected.size(), what + ": " + std::to_string(got.size()) + " ticks");
+
+	for (std::size_t i = 0; i < std::min(got.size(), expected.size()); ++i) {
+		const auto& g = got[i];
+		const auto& e = expected[i];
+
+		check(
+			g.epoch == e.epoch && g.kind == e.kind && std::fabs(g.price - e.price) < 1e-9,
+			what + ": tick " + std::to_string(i) + " at " + std::to_string(g.epoch)
+		);
+	}
+}
+
+void
+test_plan(const fs::path& dir) {
+	// the same hour as .log and .log.gz keeps the .log, whatever the order
+	for (bool reversed : { false, true }) {
+		std::vector<std::string> names {
+			"EURUSD_BID_2024-03-04_01.log.gz",
+			"EURUSD_BID_2024-03-04_01.log",
+			"EURUSD_ASK_2024-03-04_01.log.gz",
+		};
+		if (reversed) std::swap(names[0], names[1]);
+
+		const auto plan = plan_batches(names);
+		check(plan.days.size() == 1 && plan.days[0].bid == std::vector<std::string>{ "EURUSD_BID_2024-03-04_01.log" },
+			"plain copy planned");
+		check(plan.unrecognized == std::vector<std::string>{ "EURUSD_BID_2024-03-04_01.log.gz" },
+			"compressed copy left over");
+	}
+
+	const auto plan = plan_batches(dir);
+	check(plan.days.size() == 2, "one day per symbol");
+}
+
+void
+test_range() {
+	check(parse_hour_range("2024-03-04_17", "").first == 2024030417, "hour bound");
+	check(parse_hour_range("", "2024-03-04").last == 2024030423, "day bound");
+
+	// a bound is exactly yyyy-mm-dd or yyyy-mm-dd_hh
+	for (const char* bad : { "2024-03-04_17xyz", "2024-03-04x", "2024-03-04_7", "2024-03-04_0017", "2024-03-04_" }) {
+		bool rejected = false;
+		try {
+			parse_hour_range(bad, "");
+		} catch (const std::invalid_argument&) {
+			rejected = true;
+		}
+		check(rejected, std::string("bound rejected: ") + bad);
+	}
+}
+
+void
+test_raw(const fs::path& dir) {
+	{
+		TickReplay replay{dir, "EURUSD", { .mode = ReplayMode::Raw }};
+		check(replay.ask_files() == 2 && replay.bid_files() == 2, "two hour files per side");
+	}
+
+	const std::vector<ReplayTick> expected {
+		{ HOUR_0 + 100,  1.10000, 1.0, TickKind::Bid },
+		{ HOUR_0 + 100,  1.10010, 1.0, TickKind::Ask },
+		{ HOUR_0 + 200,  1.10020, 1.0, TickKind::Bid },
+		{ HOUR_0 + 300,  1.10030, 2.0, TickKind::Ask },
+		{ HOUR_0 + 1500, 1.10050, 1.0, TickKind::Ask },
+		{ HOUR_0 + 1600, 1.10040, 3.0, TickKind::Bid },
+		{ HOUR_1,        1.10090, 1.0, TickKind::Bid },
+		{ HOUR_1,        1.10100, 1.0, TickKind::Ask },
+		{ HOUR_1 + 400,  1.10110, 1.0, TickKind::Bid },
+		{ HOUR_1 + 500,  1.10120, 1.0, TickKind::Ask },
+	};
+
+	for (bool read_ahead : { false, true }) {
+		const auto what = std::string("raw, read_ahead=") + (read_ahead ? "1" : "0");
+		check_ticks(replay_all(dir, { .mode = ReplayMode::Raw, .read_ahead = read_ahead }), expected, what);
+	}
+
+	const auto range = parse_hour_range("2024-03-04_01", "2024-03-04_01");
+	check_ticks(
+		replay_all(dir, { .mode = ReplayMode::Raw, .range = range }),
+		{ expected.begin() + 6, expected.end() },
+		"raw, second hour only"
+	);
+}
+
+void
+test_mid(const fs::path& dir) {
+	// a mid tick needs both sides; the hour gap resets them
+	const std::vector<ReplayTick> expected {
+		{ HOUR_0 + 100,  1.10005, 1.0, TickKind::Mid },
+		{ HOUR_0 + 200,  1.10015, 1.0, TickKind::Mid },
+		{ HOUR_0 + 300,  1.10025, 1.0, TickKind::Mid },
+		{ HOUR_0 + 1500, 1.10035, 1.0, TickKind::Mid },
+		{ HOUR_0 + 1600, 1.10045, 1.0, TickKind::Mid },
+		{ HOUR_1 + 400,  1.10105, 1.0, TickKind::Mid },
+		{ HOUR_1 + 500,  1.10115, 1.0, TickKind::Mid },
+	};
+
+	check_ticks(replay_all(dir, {}), expected, "mid");
+}
+
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		std::fprintf(stderr, "usage: replay_test <fixture dir>\n");
+		return 2;
+	}
+
+	const fs::path dir = argv[1];
+
+	test_plan(dir);
+	test_range();
+	test_raw(dir);
+	test_mid(dir);
+
+	if (failures) return EXIT_FAILURE;
+
+	std::printf("replay_test: ok\n");
+	return EXIT_SUCCESS;
+}